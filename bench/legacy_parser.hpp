@@ -0,0 +1,54 @@
+#ifndef __LEGACY_PARSER_HPP__
+#define __LEGACY_PARSER_HPP__
+
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <strings.h>
+
+// The original request line and header helpers, kept so parser_bench can compare against them
+
+inline void legacy_get_req_info(const std::string &req, std::string &method, std::string &path, std::string &version) {
+  const char *data = req.data();
+  int field = 0;
+
+  /* loop through the request line */
+  for (size_t i = 0; i < strlen(data) && data[i] != '\n'; ++i) {
+    if (isspace(data[i])) {
+      if (i > 0 && !isspace(data[i - 1]))
+        ++field;
+      continue;
+    }
+
+    switch (field) {
+      case 0: method += data[i]; break;
+      case 1: path += data[i]; break;
+      case 2: version += data[i]; break;
+      default: return; /* nothing left to extract */
+    }
+  }
+}
+
+inline std::string legacy_get_header_value(const std::string &req, const std::string &name) {
+  size_t line_start = req.find('\n');
+
+  while (line_start != std::string::npos) {
+    ++line_start;
+    size_t line_end = req.find('\n', line_start);
+    size_t colon = req.find(':', line_start);
+
+    if (colon != std::string::npos && colon < line_end && colon - line_start == name.length() &&
+        strncasecmp(req.data() + line_start, name.data(), name.length()) == 0) {
+      std::string value = req.substr(colon + 1, line_end - colon - 1);
+      value.erase(0, value.find_first_not_of(" \t"));
+      value.erase(value.find_last_not_of(" \t\r") + 1);
+      return value;
+    }
+
+    line_start = line_end;
+  }
+
+  return "";
+}
+
+#endif
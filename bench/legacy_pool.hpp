@@ -0,0 +1,111 @@
+#ifndef __LEGACY_POOL_HPP__
+#define __LEGACY_POOL_HPP__
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <queue>
+#include <condition_variable>
+
+#include "util/pool.hpp" // job_t::info_t
+
+// The original thread pool (one mutex-guarded queue of copied std::function jobs), kept verbatim
+// so pool_bench can compare the work-stealing pool against it
+
+struct legacy_job_t {
+  job_t::info_t info;
+  std::function<void(job_t::info_t)> func;
+};
+
+class legacy_thread_pool {
+  public:
+    legacy_thread_pool(int num_threads = 0); // 0 = use hardware_concurrency
+    ~legacy_thread_pool();
+
+    void queue_job(const legacy_job_t &job);
+    bool is_busy(void);
+    size_t get_thread_count() const { return threads.size(); }
+  private:
+    void thread_loop(void);
+
+    bool should_terminate = false;
+    std::mutex queue_mutex;
+    std::condition_variable mutex_condition;
+    std::vector<std::thread> threads;
+    std::queue<legacy_job_t> jobs;
+};
+
+// Creates the thread pool, populates the pool with specified or max threads
+inline legacy_thread_pool::legacy_thread_pool(int requested_threads) {
+  // Use hardware concurrency if 0 or invalid value provided
+  uint32_t num_threads = (requested_threads > 0)
+    ? static_cast<uint32_t>(requested_threads)
+    : std::thread::hardware_concurrency();
+
+  this->threads.resize(num_threads); // resize threads vector
+
+  for (auto &thread : this->threads) {
+    thread = std::thread(&legacy_thread_pool::thread_loop, this); // initialise every thread
+  }
+}
+
+// Close all open threads, letting them finish each job first
+inline legacy_thread_pool::~legacy_thread_pool() {
+  { // after the mutex goes out of scope it is released
+    std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
+    this->should_terminate = true;
+  }
+
+  mutex_condition.notify_all();
+  for (auto &thread : this->threads) {
+    thread.join();
+  }
+
+  threads.clear();
+}
+
+// Enqueue a job to the thread pool
+inline void legacy_thread_pool::queue_job(const legacy_job_t &job) {
+  { // after the mutex goes out of scope it is released
+    std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
+    this->jobs.push(job);
+  }
+  mutex_condition.notify_one();
+}
+
+// Return if the pool is currently completing jobs
+inline bool legacy_thread_pool::is_busy(void) {
+  bool pool_busy;
+  { // after the mutex goes out of scope it is released
+    std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
+    pool_busy = !jobs.empty();
+  }
+
+  return pool_busy;
+}
+
+// Main function for each thread. The thread waits for a job to become available then executes
+inline void legacy_thread_pool::thread_loop(void) {
+  for (;;) {
+    legacy_job_t job;
+
+    { // look for next job
+      std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
+      mutex_condition.wait(lock, [this] {
+        return !this->jobs.empty() || this->should_terminate;
+      });
+
+      if (should_terminate)
+        return;
+      
+      job = jobs.front(); // get the next job
+      jobs.pop(); // dequeue current job
+    }
+
+    // run the job
+    job.func(job.info);
+  }
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "http/parser.hpp"
+#include "legacy_parser.hpp"
+
+// Request head parsing cost for a small, a typical browser and a cookie-heavy request.
+//   parser:      whole head already buffered, parsed in one call
+//   incremental: head arrives in 64 byte pieces, parse() is retried after each one
+//   legacy:      the original helpers, request line plus the headers the server looks up
+// usage: parser_bench [iterations=200000]
+
+using bench_clock = std::chrono::steady_clock;
+
+static volatile size_t sink; // keeps results alive so the loops are not optimised away
+
+static std::string browser_request(size_t cookie_bytes) {
+  std::string request =
+    "GET /css/style.css?v=3 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-GB,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "If-None-Match: \"c63db4e1a9ae7d97\"\r\n";
+  if (cookie_bytes > 0)
+    request += "Cookie: session=" + std::string(cookie_bytes, 'x') + "\r\n";
+  return request + "\r\n";
+}
+
+template <typename Body>
+static double time_ns(long iterations, Body body) {
+  auto start = bench_clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    body();
+  }
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  long iterations = argc > 1 ? std::atol(argv[1]) : 200000;
+
+  struct fixture { const char *name; std::string request; };
+  std::vector<fixture> fixtures = {
+    { "minimal", "GET / HTTP/1.1\r\nHost: a\r\n\r\n" },
+    { "browser", browser_request(0) },
+    { "cookies", browser_request(4000) },
+  };
+
+  std::cout << std::left << std::setw(10) << "request" << std::right << std::setw(8) << "bytes"
+            << std::setw(14) << "parser ns" << std::setw(16) << "incremental ns" << std::setw(12) << "legacy ns"
+            << std::setw(12) << "parser MB/s" << "\n";
+
+  for (const fixture &f : fixtures) {
+    http_parser parser(16384, 100);
+    http_request request;
+
+    double whole = time_ns(iterations, [&] {
+      parser.reset();
+      parser.parse(f.request, request);
+      sink = request.header_value("Accept-Encoding").size();
+    });
+
+    double incremental = time_ns(iterations / 4, [&] {
+      parser.reset();
+      for (size_t length = 64; ; length += 64) {
+        if (parser.parse(std::string_view(f.request).substr(0, length), request) != http_parser::status::incomplete || length >= f.request.size())
+          break;
+      }
+      sink = request.headers.size();
+    });
+
+    double legacy = time_ns(iterations / 4, [&] {
+      std::string method, path, version;
+      legacy_get_req_info(f.request, method, path, version);
+      sink = path.size() + legacy_get_header_value(f.request, "Connection").size() +
+             legacy_get_header_value(f.request, "Accept-Encoding").size() +
+             legacy_get_header_value(f.request, "If-None-Match").size() +
+             legacy_get_header_value(f.request, "Range").size();
+    });
+
+    std::cout << std::left << std::setw(10) << f.name << std::right << std::setw(8) << f.request.size()
+              << std::fixed << std::setprecision(1)
+              << std::setw(14) << whole << std::setw(16) << incremental << std::setw(12) << legacy
+              << std::setw(12) << f.request.size() / whole * 1000.0 << "\n";
+  }
+
+  return 0;
+}
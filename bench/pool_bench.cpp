@@ -0,0 +1,97 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+
+#include "util/pool.hpp"
+#include "util/log.hpp"
+#include "legacy_pool.hpp"
+
+// Compares the work-stealing thread_pool against the original single-queue pool.
+//   throughput: one producer queues many tiny jobs, time until all of them have run
+//   latency:    one job at a time into an idle pool, time from queue_job() until the job starts
+// usage: pool_bench [max_threads=64] [throughput_jobs=200000] [latency_samples=2000]
+
+using bench_clock = std::chrono::steady_clock;
+
+struct result {
+  std::string pool;
+  int threads;
+  double jobs_per_second;
+  double p50_us, p99_us;
+};
+
+static double percentile(std::vector<double> &samples, double fraction) {
+  std::sort(samples.begin(), samples.end());
+  return samples[std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()))];
+}
+
+// Wait for a counter without burning the core the workers need
+static void wait_for(const std::atomic<long> &counter, long target) {
+  while (counter.load(std::memory_order_acquire) < target) {
+    std::this_thread::yield();
+  }
+}
+
+template <typename Pool, typename Job>
+static result run(const std::string &name, int threads, long jobs, int samples) {
+  Pool pool(threads);
+  result out = { name, threads, 0, 0, 0 };
+
+  // throughput
+  std::atomic<long> done{0};
+  auto start = bench_clock::now();
+  for (long i = 0; i < jobs; ++i) {
+    pool.queue_job(Job{ {}, [&done](job_t::info_t) { done.fetch_add(1, std::memory_order_release); } });
+  }
+  wait_for(done, jobs);
+  out.jobs_per_second = jobs / std::chrono::duration<double>(bench_clock::now() - start).count();
+
+  // dispatch latency, each job is queued only after the previous one finished
+  std::vector<double> latencies;
+  latencies.reserve(samples);
+  std::atomic<long> ran{0};
+  for (int i = 0; i < samples; ++i) {
+    bench_clock::time_point queued = bench_clock::now(), started;
+    pool.queue_job(Job{ {}, [&started, &ran](job_t::info_t) {
+      started = bench_clock::now();
+      ran.fetch_add(1, std::memory_order_release);
+    } });
+    wait_for(ran, i + 1);
+    latencies.push_back(std::chrono::duration<double, std::micro>(started - queued).count());
+  }
+
+  out.p50_us = percentile(latencies, 0.50);
+  out.p99_us = percentile(latencies, 0.99);
+  return out;
+}
+
+int main(int argc, char *argv[]) {
+  int max_threads = argc > 1 ? std::atoi(argv[1]) : 64;
+  long jobs = argc > 2 ? std::atol(argv[2]) : 200000;
+  int samples = argc > 3 ? std::atoi(argv[3]) : 2000;
+
+  std::vector<result> results;
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    results.push_back(run<legacy_thread_pool, legacy_job_t>("legacy", threads, jobs, samples));
+    results.push_back(run<thread_pool, job_t>("stealing", threads, jobs, samples));
+  }
+
+  close_log_file(); // flush the pools' log lines before the table
+
+  std::cout << std::left << std::setw(10) << "pool" << std::right << std::setw(8) << "threads"
+            << std::setw(14) << "jobs/s" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << "\n";
+  for (const result &r : results) {
+    std::cout << std::left << std::setw(10) << r.pool << std::right << std::setw(8) << r.threads
+              << std::setw(14) << std::fixed << std::setprecision(0) << r.jobs_per_second
+              << std::setw(12) << std::setprecision(2) << r.p50_us
+              << std::setw(12) << r.p99_us << "\n";
+  }
+
+  return 0;
+}
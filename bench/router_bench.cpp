@@ -0,0 +1,86 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include "http/router.hpp"
+
+// Route lookup cost for sites of growing size, paths shaped like a mounted asset tree
+// (/assets/<section>/<name>.<ext>). Each lookup starts from the request target as a string_view.
+//   table:  route_table::find on the view, one slot probe and no allocation
+//   map:    the original unordered_map<std::string, ...>, which needs a std::string key per lookup
+// Two thirds of the lookups hit a route, the rest miss.
+// usage: router_bench [lookups=1000000]
+
+using bench_clock = std::chrono::steady_clock;
+
+static volatile size_t sink; // keeps results alive so the loops are not optimised away
+
+template <typename Body>
+static double time_ns(long iterations, Body body) {
+  auto start = bench_clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    body(i);
+  }
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / iterations;
+}
+
+static std::vector<std::string> make_paths(size_t count) {
+  static const char *sections[] = { "img", "css", "js", "fonts", "docs/guide", "docs/api", "media/video" };
+  static const char *extensions[] = { "png", "css", "js", "woff2", "html", "json", "mp4" };
+
+  std::vector<std::string> paths = { "/", "/404", "/favicon.ico" };
+  for (size_t i = 0; paths.size() < count; ++i) {
+    size_t kind = i % 7;
+    paths.push_back(std::string("/assets/") + sections[kind] + "/item-" + std::to_string(i) + "." + extensions[kind]);
+  }
+  return paths;
+}
+
+int main(int argc, char *argv[]) {
+  long lookups = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+  std::cout << std::right << std::setw(8) << "routes" << std::setw(12) << "table ns" << std::setw(10) << "map ns" << "\n";
+
+  for (size_t count : { 16, 256, 4096, 65536 }) {
+    std::vector<std::string> paths = make_paths(count);
+
+    std::vector<std::pair<std::string, uint32_t>> routes;
+    std::unordered_map<std::string, uint32_t> map;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      routes.emplace_back(paths[i], i);
+      map.emplace(paths[i], i);
+    }
+    route_table table(std::move(routes));
+
+    // the targets live in one buffer, as they would in a receive buffer
+    std::mt19937 rng(42);
+    std::vector<std::string> targets;
+    for (size_t i = 0; i < 4096; ++i) {
+      std::string path = paths[rng() % paths.size()];
+      if (i % 3 == 2)
+        path += ".missing";
+      targets.push_back(path);
+    }
+    std::vector<std::string_view> views(targets.begin(), targets.end());
+
+    double perfect = time_ns(lookups, [&](long i) {
+      sink = table.find(views[i & 4095]);
+    });
+
+    double hashed = time_ns(lookups, [&](long i) {
+      auto route = map.find(std::string(views[i & 4095]));
+      sink = route == map.end() ? 0 : route->second;
+    });
+
+    std::cout << std::setw(8) << paths.size() << std::fixed << std::setprecision(1)
+              << std::setw(12) << perfect << std::setw(10) << hashed << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,577 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+#include <openssl/err.h>
+
+// End-to-end load test of the real server binary. Generates a throwaway certificate and a public/
+// fixture in a temporary directory, starts serve there on a loopback port and drives it with
+// closed-loop HTTP/1.1 clients over TLS, one thread each. Prints one JSON object for regression tracking.
+//
+// usage: serve_bench [options]
+//   --concurrency N        client threads, each with one connection at a time (8)
+//   --duration S           measured seconds (10)
+//   --warmup S             seconds run before measuring (1)
+//   --reuse N              requests per connection before reconnecting, 1 = a handshake per request (100)
+//   --resume               resume the previous TLS session on reconnect
+//   --mix PATH=W,...       request mix by weight (/=40,/css/style.css=30,/js/app.js=20,/img/photo.bin=5,/missing=5)
+//   --accept-encoding E    sent with every request, e.g. gzip (none)
+//   --io-engine pool|reactor
+//   --set KEY=VALUE        any other secure-serve.conf line, repeatable
+//   --key rsa|ec           server key, RSA 2048 or P-256 (rsa)
+//   --port P               loopback port, 0 picks a free one (0)
+//   --server PATH          serve binary (the one built next to this benchmark)
+//   --keep                 leave the temporary directory and the server's output behind
+
+using bench_clock = std::chrono::steady_clock;
+
+struct options {
+  int concurrency = 8;
+  double duration = 10, warmup = 1;
+  int reuse = 100;
+  bool resume = false;
+  std::vector<std::pair<std::string, int>> mix = {
+    { "/", 40 }, { "/css/style.css", 30 }, { "/js/app.js", 20 }, { "/img/photo.bin", 5 }, { "/missing", 5 }
+  };
+  std::string accept_encoding;
+  std::string io_engine = "reactor";
+  std::vector<std::string> settings;
+  std::string key = "rsa";
+  int port = 0;
+  std::string server = SERVE_BINARY;
+  bool keep = false;
+};
+
+// What one client thread saw, merged once the run is over
+struct client_stats {
+  std::vector<uint64_t> latency_ns, handshake_ns;
+  uint64_t requests = 0, errors = 0, bytes = 0, handshakes = 0, resumed = 0;
+  std::map<int, uint64_t> statuses;
+};
+
+struct ssl_ctx_free { void operator()(SSL_CTX *ctx) const { SSL_CTX_free(ctx); } };
+using ctx_ptr = std::unique_ptr<SSL_CTX, ssl_ctx_free>;
+
+static void check(bool ok, const std::string &what) {
+  if (!ok) {
+    ERR_print_errors_fp(stderr);
+    throw std::runtime_error(what);
+  }
+}
+
+static options parse_options(int argc, char *argv[]) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc)
+        throw std::runtime_error(arg + " needs a value");
+      return argv[++i];
+    };
+
+    if (arg == "--concurrency") opts.concurrency = std::max(1, std::stoi(value()));
+    else if (arg == "--duration") opts.duration = std::stod(value());
+    else if (arg == "--warmup") opts.warmup = std::stod(value());
+    else if (arg == "--reuse") opts.reuse = std::max(1, std::stoi(value()));
+    else if (arg == "--resume") opts.resume = true;
+    else if (arg == "--accept-encoding") opts.accept_encoding = value();
+    else if (arg == "--io-engine") opts.io_engine = value();
+    else if (arg == "--set") opts.settings.push_back(value());
+    else if (arg == "--key") opts.key = value();
+    else if (arg == "--port") opts.port = std::stoi(value());
+    else if (arg == "--server") opts.server = value();
+    else if (arg == "--keep") opts.keep = true;
+    else if (arg == "--mix") {
+      opts.mix.clear();
+      std::stringstream entries(value());
+      std::string entry;
+      while (std::getline(entries, entry, ',')) {
+        size_t equals = entry.rfind('=');
+        int weight = equals == std::string::npos ? 1 : std::stoi(entry.substr(equals + 1));
+        if (weight > 0)
+          opts.mix.emplace_back(entry.substr(0, equals), weight);
+      }
+      if (opts.mix.empty())
+        throw std::runtime_error("--mix has no paths");
+    } else {
+      throw std::runtime_error("unknown option " + arg);
+    }
+  }
+  return opts;
+}
+
+/*************************************
+ * Fixture and server process
+**************************************/
+
+// Self-signed certificate for localhost, written as PEM for the server to load
+static void write_identity(const std::filesystem::path &directory, const std::string &type) {
+  EVP_PKEY *key = type == "ec" ? EVP_EC_gen("P-256") : EVP_RSA_gen(2048);
+  X509 *cert = X509_new();
+  check(key && cert, "Unable to create a key and certificate");
+
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  check(X509_sign(cert, key, EVP_sha256()) > 0, "Unable to sign the certificate");
+
+  FILE *cert_file = fopen((directory / "server.crt").c_str(), "w");
+  FILE *key_file = fopen((directory / "server.key").c_str(), "w");
+  check(cert_file && key_file, "Unable to write the certificate");
+  check(PEM_write_X509(cert_file, cert) == 1 && PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr) == 1,
+        "Unable to write the certificate");
+  fclose(cert_file);
+  fclose(key_file);
+  X509_free(cert);
+  EVP_PKEY_free(key);
+}
+
+// Text that compresses like real markup: words from a small vocabulary in a fixed pseudo-random order
+static std::string filler_text(size_t size, const char *prefix, const char *suffix) {
+  static const char *words[] = { "div", "class", "section", "header", "content", "link", "margin", "padding",
+                                 "function", "return", "const", "value", "border", "display", "flex", "color" };
+  std::mt19937 rng(size);
+  std::string text = prefix;
+  while (text.size() < size) {
+    text += words[rng() % (sizeof(words) / sizeof(words[0]))];
+    text += rng() % 8 == 0 ? "\n" : " ";
+  }
+  return text + suffix;
+}
+
+static void write_file(const std::filesystem::path &path, const std::string &contents) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+  check(out.good(), "Unable to write " + path.string());
+}
+
+// The server runs in site/ and writes its logs to ../logs, as in a deployment
+static void write_fixture(const std::filesystem::path &root, const options &opts, int port) {
+  std::filesystem::path site = root / "site";
+  std::filesystem::create_directories(root / "logs");
+  std::filesystem::create_directories(site / "secret");
+  write_identity(site / "secret", opts.key);
+
+  write_file(site / "public/index.html", filler_text(8 * 1024, "<!DOCTYPE html>\n<html><body>\n", "</body></html>\n"));
+  write_file(site / "public/404.html", "<!DOCTYPE html>\n<html><body><h1>404</h1></body></html>\n");
+  write_file(site / "public/css/style.css", filler_text(16 * 1024, "body {\n", "}\n"));
+  write_file(site / "public/js/app.js", filler_text(64 * 1024, "(function() {\n", "})();\n"));
+
+  std::string photo(2 * 1024 * 1024, '\0'); // above stream_threshold, served from a mapping
+  std::mt19937 rng(42);
+  std::generate(photo.begin(), photo.end(), [&rng]() { return static_cast<char>(rng()); });
+  write_file(site / "public/img/photo.bin", photo);
+
+  write_file(site / "public/endpoints.conf",
+             "/ ./public/index.html text/html\n"
+             "/404 ./public/404.html text/html\n"
+             "/css/* ./public/css/\n"
+             "/js/* ./public/js/\n"
+             "/img/* ./public/img/\n");
+
+  // limits that would otherwise throttle or close the benchmark's own connections
+  std::ostringstream config;
+  config << "server_port=" << port << "\n"
+         << "io_engine=" << opts.io_engine << "\n"
+         << "router_config_path=./public/endpoints.conf\n"
+         << "watch_files=0\n"
+         << "keep_alive_timeout=60\n"
+         << "keep_alive_max_requests=100000000\n"
+         << "rate_limit_max_requests=1000000000\n"
+         << "ssl_cert_path=./secret/server.crt\n"
+         << "ssl_key_path=./secret/server.key\n";
+  for (const std::string &setting : opts.settings) {
+    config << setting << "\n";
+  }
+  write_file(site / "secure-serve.conf", config.str());
+}
+
+// A loopback port nobody is listening on right now
+static int free_port() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  check(fd >= 0 && bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 &&
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &length) == 0, "Unable to find a free port");
+  close(fd);
+  return ntohs(addr.sin_port);
+}
+
+static int connect_loopback(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  return fd;
+}
+
+// Start the server in site/ with its output in server.out, returning once it accepts connections
+static pid_t start_server(const std::filesystem::path &root, const options &opts, int port) {
+  std::filesystem::path site = root / "site";
+  std::string output = (root / "server.out").string();
+
+  pid_t pid = fork();
+  check(pid >= 0, "Unable to start the server");
+  if (pid == 0) {
+    int out = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0 || chdir(site.c_str()) != 0)
+      _exit(127);
+    dup2(out, STDOUT_FILENO);
+    dup2(out, STDERR_FILENO);
+    execl(opts.server.c_str(), opts.server.c_str(), static_cast<char *>(nullptr));
+    _exit(127);
+  }
+
+  auto deadline = bench_clock::now() + std::chrono::seconds(30);
+  while (bench_clock::now() < deadline) {
+    int status;
+    if (waitpid(pid, &status, WNOHANG) == pid)
+      throw std::runtime_error("The server exited during startup, see " + output + " (run with --keep)");
+
+    int fd = connect_loopback(port);
+    if (fd >= 0) {
+      close(fd);
+      return pid;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+  throw std::runtime_error("The server did not start listening within 30s");
+}
+
+/*************************************
+ * Clients
+**************************************/
+
+// Read one response, returning its status or -1 on a broken connection. close_after is set when
+// the server announced it closes the connection.
+static int read_response(SSL *ssl, std::string &buffer, bool &close_after, uint64_t &bytes) {
+  char chunk[16384];
+  size_t head_end;
+  buffer.clear();
+
+  while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    int n = SSL_read(ssl, chunk, sizeof(chunk));
+    if (n <= 0 || buffer.size() > 65536)
+      return -1;
+    buffer.append(chunk, n);
+  }
+
+  if (buffer.compare(0, 5, "HTTP/") != 0 || buffer.size() < 12)
+    return -1;
+  int status = std::atoi(buffer.c_str() + 9);
+
+  size_t content_length = 0;
+  close_after = false;
+  for (size_t line = buffer.find("\r\n") + 2; line < head_end; line = buffer.find("\r\n", line) + 2) {
+    if (strncasecmp(buffer.c_str() + line, "Content-Length:", 15) == 0)
+      content_length = std::strtoull(buffer.c_str() + line + 15, nullptr, 10);
+    else if (strncasecmp(buffer.c_str() + line, "Connection: close", 17) == 0)
+      close_after = true;
+  }
+
+  size_t body = buffer.size() - head_end - 4;
+  while (body < content_length) {
+    int n = SSL_read(ssl, chunk, std::min(sizeof(chunk), content_length - body));
+    if (n <= 0)
+      return -1;
+    body += n;
+  }
+
+  bytes += head_end + 4 + content_length;
+  return status;
+}
+
+// One closed-loop client: connect, send requests one at a time, reconnect after reuse requests
+static void run_client(SSL_CTX *ctx, const options &opts, int index, bench_clock::time_point measure_from, bench_clock::time_point stop_at,
+                       client_stats &stats) {
+  std::vector<std::string> requests;
+  std::vector<int> cumulative;
+  int total_weight = 0;
+  for (const auto &[path, weight] : opts.mix) {
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nUser-Agent: serve_bench\r\n";
+    if (!opts.accept_encoding.empty())
+      request += "Accept-Encoding: " + opts.accept_encoding + "\r\n";
+    requests.push_back(request + "\r\n");
+    cumulative.push_back(total_weight += weight);
+  }
+
+  std::mt19937 rng(index + 1);
+  std::uniform_int_distribution<int> pick(0, total_weight - 1);
+  std::string buffer;
+  SSL_SESSION *session = nullptr;
+  SSL *ssl = nullptr;
+  int fd = -1, served = 0;
+
+  auto disconnect = [&]() {
+    if (ssl) {
+      SSL_shutdown(ssl); // close_notify keeps the session resumable
+      SSL_free(ssl);
+      ssl = nullptr;
+    }
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  };
+
+  for (bench_clock::time_point now = bench_clock::now(); now < stop_at; now = bench_clock::now()) {
+    bool measuring = now >= measure_from;
+
+    if (!ssl) {
+      auto started = bench_clock::now();
+      fd = connect_loopback(opts.port);
+      ssl = fd >= 0 ? SSL_new(ctx) : nullptr;
+      if (ssl) {
+        SSL_set_fd(ssl, fd);
+        if (opts.resume && session)
+          SSL_set_session(ssl, session);
+      }
+
+      if (!ssl || SSL_connect(ssl) != 1) {
+        stats.errors += measuring;
+        ERR_clear_error();
+        disconnect();
+        continue;
+      }
+
+      if (measuring) {
+        stats.handshakes++;
+        stats.resumed += SSL_session_reused(ssl);
+        stats.handshake_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - started).count());
+      }
+      served = 0;
+    }
+
+    const std::string &request = requests[std::upper_bound(cumulative.begin(), cumulative.end(), pick(rng)) - cumulative.begin()];
+    auto started = bench_clock::now();
+    bool close_after = false;
+    uint64_t bytes = 0;
+    int status = SSL_write(ssl, request.data(), request.size()) == static_cast<int>(request.size())
+                 ? read_response(ssl, buffer, close_after, bytes) : -1;
+    auto finished = bench_clock::now();
+
+    if (status < 0) {
+      stats.errors += measuring;
+      ERR_clear_error();
+      disconnect();
+      continue;
+    }
+
+    if (measuring) {
+      stats.requests++;
+      stats.bytes += bytes;
+      stats.statuses[status]++;
+      stats.latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count());
+    }
+
+    // TLS 1.3 tickets arrive after the handshake, the session is only complete once a response was read
+    if (opts.resume && served == 0) {
+      SSL_SESSION_free(session);
+      session = SSL_get1_session(ssl);
+    }
+
+    if (++served >= opts.reuse || close_after)
+      disconnect();
+  }
+
+  disconnect();
+  SSL_SESSION_free(session);
+}
+
+/*************************************
+ * Report
+**************************************/
+
+static double percentile_us(const std::vector<uint64_t> &sorted, double fraction) {
+  if (sorted.empty())
+    return 0;
+  return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))] / 1000.0;
+}
+
+static std::string json_string(const std::string &text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+static void report(const options &opts, client_stats &total, double seconds) {
+  std::sort(total.latency_ns.begin(), total.latency_ns.end());
+  std::sort(total.handshake_ns.begin(), total.handshake_ns.end());
+
+  double mean_us = 0;
+  for (uint64_t latency : total.latency_ns) {
+    mean_us += latency / 1000.0;
+  }
+  if (!total.latency_ns.empty())
+    mean_us /= total.latency_ns.size();
+
+  std::ostream &out = std::cout;
+  out << std::fixed << std::setprecision(1);
+  out << "{\n";
+  out << "  \"io_engine\": " << json_string(opts.io_engine) << ",\n";
+  out << "  \"concurrency\": " << opts.concurrency << ",\n";
+  out << "  \"requests_per_connection\": " << opts.reuse << ",\n";
+  out << "  \"resume\": " << (opts.resume ? "true" : "false") << ",\n";
+  out << "  \"key\": " << json_string(opts.key) << ",\n";
+  out << "  \"accept_encoding\": " << json_string(opts.accept_encoding) << ",\n";
+  out << "  \"mix\": {";
+  for (size_t i = 0; i < opts.mix.size(); ++i) {
+    out << (i ? ", " : "") << json_string(opts.mix[i].first) << ": " << opts.mix[i].second;
+  }
+  out << "},\n";
+  out << "  \"settings\": [";
+  for (size_t i = 0; i < opts.settings.size(); ++i) {
+    out << (i ? ", " : "") << json_string(opts.settings[i]);
+  }
+  out << "],\n";
+  out << "  \"duration_s\": " << seconds << ",\n";
+  out << "  \"requests\": " << total.requests << ",\n";
+  out << "  \"errors\": " << total.errors << ",\n";
+  out << "  \"throughput_rps\": " << total.requests / seconds << ",\n";
+  out << "  \"throughput_mib_s\": " << total.bytes / seconds / (1024 * 1024) << ",\n";
+  out << "  \"latency_us\": { \"mean\": " << mean_us << ", \"p50\": " << percentile_us(total.latency_ns, 0.50)
+      << ", \"p99\": " << percentile_us(total.latency_ns, 0.99) << ", \"p999\": " << percentile_us(total.latency_ns, 0.999)
+      << ", \"max\": " << percentile_us(total.latency_ns, 1.0) << " },\n";
+  out << "  \"handshakes\": " << total.handshakes << ",\n";
+  out << "  \"resumed_handshakes\": " << total.resumed << ",\n";
+  out << "  \"handshake_rate\": " << total.handshakes / seconds << ",\n";
+  out << "  \"handshake_us\": { \"p50\": " << percentile_us(total.handshake_ns, 0.50)
+      << ", \"p99\": " << percentile_us(total.handshake_ns, 0.99) << " },\n";
+  out << "  \"status\": {";
+  size_t i = 0;
+  for (const auto &[status, count] : total.statuses) {
+    out << (i++ ? ", " : "") << "\"" << status << "\": " << count;
+  }
+  out << "}\n";
+  out << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+  signal(SIGPIPE, SIG_IGN);
+
+  options opts;
+  try {
+    opts = parse_options(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << "serve_bench: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  char root_template[] = "/tmp/serve_bench.XXXXXX";
+  if (!mkdtemp(root_template)) {
+    std::cerr << "serve_bench: unable to create a temporary directory\n";
+    return EXIT_FAILURE;
+  }
+  std::filesystem::path root = root_template;
+  pid_t server = -1;
+  int result = EXIT_SUCCESS;
+
+  try {
+    if (opts.port == 0)
+      opts.port = free_port();
+    write_fixture(root, opts, opts.port);
+    server = start_server(root, opts, opts.port);
+    std::cerr << "serve_bench: server " << server << " on 127.0.0.1:" << opts.port << " (" << opts.io_engine << "), "
+              << opts.concurrency << " clients for " << opts.warmup << "s warmup + " << opts.duration << "s\n";
+
+    ctx_ptr ctx(SSL_CTX_new(TLS_client_method()));
+    check(ctx != nullptr, "Unable to create the client context");
+    SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_CLIENT);
+
+    auto measure_from = bench_clock::now() + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(opts.warmup));
+    auto stop_at = measure_from + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(opts.duration));
+
+    std::vector<client_stats> stats(opts.concurrency);
+    std::vector<std::thread> clients;
+    for (int i = 0; i < opts.concurrency; ++i) {
+      clients.emplace_back(run_client, ctx.get(), std::cref(opts), i, measure_from, stop_at, std::ref(stats[i]));
+    }
+    for (std::thread &client : clients) {
+      client.join();
+    }
+
+    // requests still in flight at stop_at are counted, so time the measured window up to now
+    double seconds = std::chrono::duration<double>(bench_clock::now() - measure_from).count();
+
+    client_stats total;
+    for (client_stats &each : stats) {
+      total.latency_ns.insert(total.latency_ns.end(), each.latency_ns.begin(), each.latency_ns.end());
+      total.handshake_ns.insert(total.handshake_ns.end(), each.handshake_ns.begin(), each.handshake_ns.end());
+      total.requests += each.requests;
+      total.errors += each.errors;
+      total.bytes += each.bytes;
+      total.handshakes += each.handshakes;
+      total.resumed += each.resumed;
+      for (const auto &[status, count] : each.statuses) {
+        total.statuses[status] += count;
+      }
+    }
+    report(opts, total, seconds);
+  } catch (const std::exception &e) {
+    std::cerr << "serve_bench: " << e.what() << "\n";
+    result = EXIT_FAILURE;
+  }
+
+  if (server > 0) {
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+  }
+
+  if (opts.keep) {
+    std::cerr << "serve_bench: kept " << root.string() << "\n";
+  } else {
+    std::filesystem::remove_all(root);
+  }
+  return result;
+}
@@ -0,0 +1,377 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <filesystem>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "server.hpp"
+#include "config.hpp"
+#include "util/pool.hpp"
+#include "util/log.hpp"
+#include "util/rate_limiter.hpp"
+#include "util/output_queue.hpp"
+#include "http/parser.hpp"
+#include "http/response.hpp"
+
+// Cost of the primitives every connection goes through, each measured on its own:
+//   thread_pool::queue_job  one producer, time until every queued no-op job has run
+//   log_info                request log lines from 1 and 4 threads at once, into a real log file
+//   http_parser             request heads parsed into a fresh http_request, as serve_requests does
+//   rate_limiter::allow     returning clients of a table of 1k to 1M addresses, and new clients
+//   site::get_endpoint      route lookups on sites of 256 and 65536 routes, two thirds hits
+//   response assembly       a generated 405 (add_response_code/add_header/add_body) and a
+//                           cached file response (add_cached_response), each onto an output_queue
+// Every case runs until it takes time_ms (the warmup), then repetitions more times at that size.
+// ns/op is the median repetition, min the fastest; allocs/op counts operator new calls on any thread.
+// Multi-threaded cases report wall time divided by the operations of all threads together.
+// usage: serve_microbench [filter=all] [repetitions=5] [time_ms=100]
+
+using bench_clock = std::chrono::steady_clock;
+
+static volatile size_t sink; // keeps results alive so the loops are not optimised away
+static std::atomic<unsigned long> allocations{0};
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = nullptr;
+  if (posix_memalign(&p, std::max(sizeof(void *), static_cast<size_t>(alignment)), size ? size : 1) == 0)
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+struct benchmark {
+  std::string name;
+  std::function<void(long)> run; // perform ops operations
+  std::function<std::string()> note; // optional, called once after the repetitions
+};
+
+struct result {
+  std::string name;
+  long ops;
+  double median_ns, min_ns, allocs;
+  std::string note;
+};
+
+static double time_run(const benchmark &b, long ops) {
+  auto start = bench_clock::now();
+  b.run(ops);
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+}
+
+static result measure(const benchmark &b, int repetitions, double time_ns) {
+  // warm up while growing the run until it lasts a tenth of time_ms, then scale it to the full time
+  long ops = 1;
+  double taken = time_run(b, ops);
+  while (taken < time_ns / 10 && ops < (1L << 32)) {
+    ops *= 4;
+    taken = time_run(b, ops);
+  }
+  ops = std::max(1L, static_cast<long>(ops * (time_ns / std::max(taken, 1.0))));
+  if (b.note)
+    b.note(); // forget what the warmup did
+
+  std::vector<double> samples;
+  unsigned long allocated = allocations.load();
+  for (int i = 0; i < repetitions; ++i) {
+    samples.push_back(time_run(b, ops) / ops);
+  }
+  allocated = allocations.load() - allocated;
+
+  std::sort(samples.begin(), samples.end());
+  return { b.name, ops, samples[samples.size() / 2], samples.front(), static_cast<double>(allocated) / (static_cast<double>(ops) * repetitions),
+           b.note ? b.note() : "" };
+}
+
+// Run body(thread, count) on threads threads splitting ops between them, all starting together
+template <typename Body>
+static void run_threads(int threads, long ops, Body body) {
+  std::atomic<int> ready{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    long count = ops / threads + (t < ops % threads ? 1 : 0);
+    workers.emplace_back([&ready, &body, threads, t, count] {
+      ready.fetch_add(1);
+      while (ready.load() < threads) {
+        std::this_thread::yield();
+      }
+      body(t, count);
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+static std::string browser_request(size_t cookie_bytes) {
+  std::string request =
+    "GET /css/style.css?v=3 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-GB,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "If-None-Match: \"c63db4e1a9ae7d97\"\r\n";
+  if (cookie_bytes > 0)
+    request += "Cookie: session=" + std::string(cookie_bytes, 'x') + "\r\n";
+  return request + "\r\n";
+}
+
+static std::vector<std::string> make_paths(size_t count) {
+  static const char *sections[] = { "img", "css", "js", "fonts", "docs/guide", "docs/api", "media/video" };
+  static const char *extensions[] = { "png", "css", "js", "woff2", "html", "json", "mp4" };
+
+  std::vector<std::string> paths = { "/", "/404", "/favicon.ico" };
+  for (size_t i = 0; paths.size() < count; ++i) {
+    size_t kind = i % 7;
+    paths.push_back(std::string("/assets/") + sections[kind] + "/item-" + std::to_string(i) + "." + extensions[kind]);
+  }
+  return paths;
+}
+
+static struct in_addr client_address(uint32_t index) {
+  struct in_addr address;
+  address.s_addr = htonl(0x0a000000u + index); // 10.0.0.0/8, distinct for the first 16M clients
+  return address;
+}
+
+static void add_pool_benchmarks(std::vector<benchmark> &out) {
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned workers : { 1u, cores }) {
+    auto pool = std::make_shared<thread_pool>(workers);
+    auto done = std::make_shared<std::atomic<long>>(0);
+
+    out.push_back({ "thread_pool::queue_job, " + std::to_string(workers) + " worker(s)", [pool, done](long ops) {
+      done->store(0);
+      for (long i = 0; i < ops; ++i) {
+        pool->queue_job(job_t{ {}, [done](job_t::info_t) { done->fetch_add(1, std::memory_order_release); } });
+      }
+      while (done->load(std::memory_order_acquire) < ops) {
+        std::this_thread::yield();
+      }
+    }, nullptr });
+    if (workers == cores)
+      break;
+  }
+}
+
+static void add_log_benchmarks(std::vector<benchmark> &out) {
+  for (int threads : { 1, 4 }) {
+    auto dropped = std::make_shared<unsigned long>(0);
+    auto logged = std::make_shared<long>(0);
+
+    out.push_back({ "log_info, " + std::to_string(threads) + " thread(s)", [threads, logged](long ops) {
+      run_threads(threads, ops, [](int thread, long count) {
+        struct in_addr address = client_address(thread);
+        for (long i = 0; i < count; ++i) {
+          log_info("SERVER: INCOMING CONNECTION: %12s GET %.*s -> %s", inet_ntoa(address), 18, "/css/style.css?v=3", "200 OK");
+        }
+      });
+      *logged += ops;
+    }, [dropped, logged] {
+      // share of the lines the writer could not keep up with, they were dropped rather than waited for
+      unsigned long now = get_dropped_log_count();
+      std::string note = *logged ? std::to_string(100 * (now - *dropped) / *logged) + "% dropped" : "";
+      *dropped = now;
+      *logged = 0;
+      return note;
+    } });
+  }
+}
+
+static void add_parser_benchmarks(std::vector<benchmark> &out) {
+  struct fixture { const char *name; std::string request; };
+  for (const fixture &f : { fixture{ "minimal", "GET / HTTP/1.1\r\nHost: a\r\n\r\n" }, fixture{ "browser", browser_request(0) },
+                            fixture{ "cookies", browser_request(4000) } }) {
+    auto parser = std::make_shared<http_parser>(16384, 100);
+    std::string request = f.request;
+
+    out.push_back({ std::string("http_parser::parse, ") + f.name + " (" + std::to_string(request.size()) + " B)", [parser, request](long ops) {
+      for (long i = 0; i < ops; ++i) {
+        http_request head;
+        parser->reset();
+        parser->parse(request, head);
+        sink = head.header_value("Accept-Encoding").size();
+      }
+    }, nullptr });
+  }
+}
+
+static void add_rate_limiter_benchmarks(std::vector<benchmark> &out) {
+  for (uint32_t clients : { 1000u, 100000u, 1000000u }) {
+    auto limiter = std::make_shared<rate_limiter>(1000000000, 1);
+    auto order = std::make_shared<std::vector<uint32_t>>(clients);
+    for (uint32_t i = 0; i < clients; ++i) {
+      (*order)[i] = i;
+      limiter->allow(client_address(i));
+    }
+    std::shuffle(order->begin(), order->end(), std::mt19937(42));
+
+    out.push_back({ "rate_limiter::allow, " + std::to_string(clients) + " known clients", [limiter, order](long ops) {
+      for (long i = 0; i < ops; ++i) {
+        sink = limiter->allow(client_address((*order)[i % order->size()]));
+      }
+    }, nullptr });
+  }
+
+  // every connection from a client not seen before, the table grows from empty
+  out.push_back({ "rate_limiter::allow, new clients", [](long ops) {
+    rate_limiter limiter(1000000000, 1);
+    for (long i = 0; i < ops; ++i) {
+      sink = limiter.allow(client_address(i));
+    }
+  }, nullptr });
+}
+
+static void add_endpoint_benchmarks(std::vector<benchmark> &out) {
+  for (size_t count : { 256, 65536 }) {
+    std::vector<std::string> paths = make_paths(count);
+
+    auto site = std::make_shared<https_server::site>();
+    std::vector<std::pair<std::string, uint32_t>> routes;
+    site->files.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+      site->files[i].path = paths[i];
+      routes.emplace_back(paths[i], i);
+    }
+    site->routes = route_table(std::move(routes));
+
+    // the targets live in one buffer, as they would in a receive buffer
+    std::mt19937 rng(42);
+    auto targets = std::make_shared<std::vector<std::string>>();
+    for (size_t i = 0; i < 4096; ++i) {
+      std::string path = paths[rng() % paths.size()];
+      if (i % 3 == 2)
+        path += ".missing";
+      targets->push_back(path);
+    }
+
+    out.push_back({ "site::get_endpoint, " + std::to_string(count) + " routes", [site, targets](long ops) {
+      for (long i = 0; i < ops; ++i) {
+        auto file = site->get_endpoint((*targets)[i & 4095]);
+        sink = file ? file->get().path.size() : 0;
+      }
+    }, nullptr });
+  }
+}
+
+static void add_response_benchmarks(std::vector<benchmark> &out) {
+  auto response = std::make_shared<output_queue>();
+
+  // the answer to a method other than GET, as handle_request builds it
+  out.push_back({ "response, generated 405", [response](long ops) {
+    for (long i = 0; i < ops; ++i) {
+      response->clear();
+      std::string not_allowed;
+      add_response_code(not_allowed, 405, "METHOD NOT ALLOWED");
+      add_header(not_allowed, "Content-Type", "text/plain");
+      add_header(not_allowed, "Allow", "GET");
+      add_body(not_allowed, "405 - Method Not Allowed", true);
+      response->append(not_allowed);
+      sink = response->size();
+    }
+  }, nullptr });
+
+  // a cached file: the head serialized at load plus Connection, the body referenced
+  auto header = std::make_shared<std::string>(
+    "HTTP/1.1 200 OK\r\nContent-Type: text/css\r\nContent-Length: 16384\r\nETag: \"c63db4e1a9ae7d97\"\r\n"
+    "Last-Modified: Sat, 17 Oct 2026 02:48:58 GMT\r\nAccept-Ranges: bytes\r\nVary: Accept-Encoding\r\n");
+  auto body = std::make_shared<std::string>(16384, 'x');
+  out.push_back({ "response, cached file", [response, header, body](long ops) {
+    for (long i = 0; i < ops; ++i) {
+      response->clear();
+      add_cached_response(*response, *header, *body, true);
+      sink = response->size();
+    }
+  }, nullptr });
+}
+
+int main(int argc, char *argv[]) {
+  std::string filter = argc > 1 ? argv[1] : "all";
+  int repetitions = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+  double time_ns = (argc > 3 ? std::atof(argv[3]) : 100) * 1e6;
+
+  // log_info writes to ../logs/server.log and stdout: give it a scratch directory and keep the
+  // lines out of the table, which is printed once the writer has finished
+  char base[] = "/tmp/serve_microbench.XXXXXX";
+  if (!mkdtemp(base)) {
+    std::cerr << "serve_microbench: cannot create a scratch directory\n";
+    return 1;
+  }
+  std::filesystem::create_directories(std::string(base) + "/logs");
+  std::filesystem::create_directories(std::string(base) + "/run");
+  std::filesystem::current_path(std::string(base) + "/run");
+
+  int saved_stdout = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+  close(null_fd);
+
+  server_config defaults;
+  configure_logging(defaults.log_flush_interval.count(), defaults.log_max_size, defaults.log_max_segments);
+
+  std::vector<benchmark> benchmarks;
+  add_pool_benchmarks(benchmarks);
+  add_log_benchmarks(benchmarks);
+  add_parser_benchmarks(benchmarks);
+  add_rate_limiter_benchmarks(benchmarks);
+  add_endpoint_benchmarks(benchmarks);
+  add_response_benchmarks(benchmarks);
+
+  std::vector<result> results;
+  for (const benchmark &b : benchmarks) {
+    if (filter == "all" || b.name.find(filter) != std::string::npos)
+      results.push_back(measure(b, repetitions, time_ns));
+  }
+  benchmarks.clear(); // stops the pools
+
+  close_log_file();
+  std::cout.flush();
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+  std::filesystem::current_path("/");
+  std::filesystem::remove_all(base);
+
+  std::cout << std::left << std::setw(46) << "benchmark" << std::right << std::setw(12) << "ops"
+            << std::setw(12) << "ns/op" << std::setw(12) << "min ns/op" << std::setw(12) << "allocs/op" << "  note\n";
+  for (const result &r : results) {
+    std::cout << std::left << std::setw(46) << r.name << std::right << std::setw(12) << r.ops
+              << std::setw(12) << std::fixed << std::setprecision(1) << r.median_ns
+              << std::setw(12) << r.min_ns
+              << std::setw(12) << std::setprecision(2) << r.allocs << "  " << r.note << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <chrono>
+#include <stdexcept>
+#include <cstdlib>
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/err.h>
+
+#include "util/tls_session.hpp"
+
+// Server CPU spent per TLS handshake with and without session resumption. Client and server run
+// in this thread over an in-memory BIO pair, so no network time is counted and only the server's
+// SSL_do_handshake calls are timed. The server certificate is a fresh RSA 2048 key, like the one
+// the deployment uses, so a full handshake pays for one RSA signature and an ECDHE exchange.
+//   full:     no session offered
+//   tickets:  the session from the previous connection, sealed in a ticket by ticket_keys
+//   cache:    tickets off, the session is found in the server-side session cache
+// usage: tls_resume_bench [handshakes=500]
+
+using bench_clock = std::chrono::steady_clock;
+
+struct ssl_ctx_free { void operator()(SSL_CTX *ctx) const { SSL_CTX_free(ctx); } };
+struct ssl_free { void operator()(SSL *ssl) const { SSL_free(ssl); } };
+using ctx_ptr = std::unique_ptr<SSL_CTX, ssl_ctx_free>;
+using ssl_ptr = std::unique_ptr<SSL, ssl_free>;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    ERR_print_errors_fp(stderr);
+    throw std::runtime_error(what);
+  }
+}
+
+// Self-signed RSA 2048 certificate for the server
+static void use_fresh_identity(SSL_CTX *ctx) {
+  EVP_PKEY *key = EVP_RSA_gen(2048);
+  X509 *cert = X509_new();
+  check(key && cert, "Unable to create a key and certificate");
+
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+  X509_set_pubkey(cert, key);
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+  check(X509_sign(cert, key, EVP_sha256()) > 0, "Unable to sign the certificate");
+
+  check(SSL_CTX_use_certificate(ctx, cert) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1, "Unable to load the certificate");
+  X509_free(cert);
+  EVP_PKEY_free(key);
+}
+
+// One connection: handshake, then one byte each way so TLS 1.3 tickets reach the client.
+// Adds the time spent in the server's calls to server_time and returns the client's session.
+static SSL_SESSION *connect(SSL_CTX *server_ctx, SSL_CTX *client_ctx, SSL_SESSION *offer, bench_clock::duration &server_time, bool &resumed) {
+  ssl_ptr server(SSL_new(server_ctx)), client(SSL_new(client_ctx));
+  BIO *server_bio, *client_bio;
+  check(server && client && BIO_new_bio_pair(&server_bio, 0, &client_bio, 0) == 1, "Unable to create a connection");
+  SSL_set_bio(server.get(), server_bio, server_bio);
+  SSL_set_bio(client.get(), client_bio, client_bio);
+  SSL_set_accept_state(server.get());
+  SSL_set_connect_state(client.get());
+  if (offer)
+    SSL_set_session(client.get(), offer);
+
+  bool server_done = false, client_done = false;
+  for (int rounds = 0; !server_done || !client_done; ++rounds) {
+    check(rounds < 100, "Handshake did not finish");
+
+    if (!client_done)
+      client_done = SSL_do_handshake(client.get()) == 1;
+
+    if (!server_done) {
+      auto start = bench_clock::now();
+      server_done = SSL_do_handshake(server.get()) == 1;
+      server_time += bench_clock::now() - start;
+    }
+  }
+
+  char byte = 'x';
+  auto start = bench_clock::now();
+  check(SSL_write(server.get(), &byte, 1) == 1, "Server write failed"); // also sends the TLS 1.3 tickets
+  server_time += bench_clock::now() - start;
+  check(SSL_read(client.get(), &byte, 1) == 1 && SSL_write(client.get(), &byte, 1) == 1, "Client exchange failed");
+  start = bench_clock::now();
+  check(SSL_read(server.get(), &byte, 1) == 1, "Server read failed");
+  server_time += bench_clock::now() - start;
+
+  // a connection freed without close_notify marks its session as not resumable
+  SSL_shutdown(client.get());
+  SSL_shutdown(server.get());
+
+  resumed = SSL_session_reused(server.get());
+  return SSL_get1_session(client.get());
+}
+
+struct result {
+  double server_us;
+  double resumed_percent;
+};
+
+static result run(int version, bool tickets, bool offer_sessions, int handshakes) {
+  ctx_ptr server_ctx(SSL_CTX_new(TLS_server_method())), client_ctx(SSL_CTX_new(TLS_client_method()));
+  check(server_ctx && client_ctx, "Unable to create contexts");
+  use_fresh_identity(server_ctx.get());
+  SSL_CTX_set_min_proto_version(client_ctx.get(), version);
+  SSL_CTX_set_max_proto_version(client_ctx.get(), version);
+
+  std::unique_ptr<ticket_keys> keys;
+  if (tickets)
+    keys = std::make_unique<ticket_keys>(std::chrono::seconds(3600), std::chrono::seconds(7200));
+  configure_session_resumption(server_ctx.get(), 20480, std::chrono::seconds(7200), keys.get());
+
+  bench_clock::duration server_time{};
+  SSL_SESSION *session = nullptr;
+  int resumed_count = 0;
+  bool resumed;
+
+  session = connect(server_ctx.get(), client_ctx.get(), nullptr, server_time, resumed); // warm up
+  server_time = {};
+
+  for (int i = 0; i < handshakes; ++i) {
+    SSL_SESSION *next = connect(server_ctx.get(), client_ctx.get(), offer_sessions ? session : nullptr, server_time, resumed);
+    SSL_SESSION_free(session);
+    session = next;
+    resumed_count += resumed;
+  }
+  SSL_SESSION_free(session);
+
+  return { std::chrono::duration<double, std::micro>(server_time).count() / handshakes, 100.0 * resumed_count / handshakes };
+}
+
+int main(int argc, char *argv[]) {
+  int handshakes = argc > 1 ? std::atoi(argv[1]) : 500;
+
+  std::cout << std::left << std::setw(10) << "version" << std::setw(10) << "mode" << std::right
+            << std::setw(12) << "server us" << std::setw(10) << "resumed" << std::setw(10) << "saved" << "\n";
+
+  for (int version : { TLS1_3_VERSION, TLS1_2_VERSION }) {
+    result full = run(version, true, false, handshakes);
+    result tickets = run(version, true, true, handshakes);
+    result cache = run(version, false, true, handshakes);
+
+    auto print = [&](const char *mode, const result &r) {
+      std::cout << std::left << std::setw(10) << (version == TLS1_3_VERSION ? "TLSv1.3" : "TLSv1.2") << std::setw(10) << mode << std::right
+                << std::fixed << std::setprecision(1) << std::setw(12) << r.server_us << std::setw(9) << r.resumed_percent << "%"
+                << std::setw(9) << 100.0 * (1.0 - r.server_us / full.server_us) << "%\n";
+    };
+    print("full", full);
+    print("tickets", tickets);
+    print("cache", cache);
+  }
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdlib>
+
+#include "http/parser.hpp"
+
+// Fuzz target for the request head parser. Built with clang it is a libFuzzer target:
+//   parser_fuzz fuzz/corpus/parser
+// with other compilers it only replays the given files or corpus directories, so crashes found
+// elsewhere can be reproduced.
+
+static bool within(std::string_view inner, std::string_view outer) {
+  return inner.empty() || (inner.data() >= outer.data() && inner.data() + inner.size() <= outer.data() + outer.size());
+}
+
+// Every view must point into the parsed head
+static void check_request(const http_request &request, std::string_view head) {
+  if (!within(request.method, head) || !within(request.target, head) || !within(request.version, head))
+    abort();
+
+  for (const http_request::header &field : request.headers) {
+    if (field.name.empty() || !within(field.name, head) || !within(field.value, head))
+      abort();
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  std::string_view input(reinterpret_cast<const char *>(data), size);
+  http_parser parser(4096, 32);
+  http_request request;
+
+  http_parser::status whole = parser.parse(input, request);
+  size_t whole_length = parser.head_length();
+  int whole_error = parser.error_code();
+  if (whole == http_parser::status::complete) {
+    if (whole_length == 0 || whole_length > size)
+      abort();
+    check_request(request, input.substr(0, whole_length));
+  }
+
+  // feeding the same bytes one at a time must end in the same place
+  parser.reset();
+  http_parser::status incremental = http_parser::status::incomplete;
+  for (size_t length = 1; length <= size && incremental == http_parser::status::incomplete; ++length) {
+    incremental = parser.parse(input.substr(0, length), request);
+  }
+
+  if (incremental != whole)
+    abort();
+  if (whole == http_parser::status::complete && parser.head_length() != whole_length)
+    abort();
+  if (whole == http_parser::status::error && whole_error != 431 && parser.error_code() != whole_error)
+    abort();
+
+  return 0;
+}
+
+#ifndef FUZZING_ENGINE
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <filesystem>
+
+static int replay(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(contents.data()), contents.size());
+}
+
+int main(int argc, char *argv[]) {
+  size_t count = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::filesystem::is_directory(argv[i])) {
+      for (const auto &entry : std::filesystem::directory_iterator(argv[i])) {
+        replay(entry.path());
+        count++;
+      }
+    } else {
+      replay(argv[i]);
+      count++;
+    }
+  }
+
+  std::cout << "replayed " << count << " inputs" << std::endl;
+  return 0;
+}
+#endif
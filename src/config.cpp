@@ -0,0 +1,255 @@
+#include "config.hpp"
+
+#include <variant>
+#include <charconv>
+#include <climits>
+#include <type_traits>
+#include <strings.h>
+
+using std::chrono::milliseconds;
+
+// One key of secure-serve.conf: the member it is stored in and which values are valid
+struct config_key {
+  const char *name;
+  std::variant<int server_config::*, bool server_config::*, size_t server_config::*, milliseconds server_config::*,
+               std::string server_config::*, io_engine_type server_config::*, overload_action server_config::*> field;
+  long long min = 0, max = LLONG_MAX; // inclusive, bytes for sizes and milliseconds for durations
+  milliseconds unit{1000}; // what a bare number means for a duration
+};
+
+static const config_key schema[] = {
+  { "server_port", &server_config::server_port, 1, 65535 },
+  { "backlog", &server_config::backlog, 1 },
+  { "listener_threads", &server_config::listener_threads, 0, 1024 },
+  { "io_engine", &server_config::io_engine },
+  { "thread_pool_size", &server_config::thread_pool_size, 0, 4096 },
+  { "reactor_threads", &server_config::reactor_threads, 0, 1024 },
+  { "max_queue_depth", &server_config::max_queue_depth },
+  { "max_queue_wait_ms", &server_config::max_queue_wait, 0, LLONG_MAX, milliseconds(1) },
+  { "overload_response", &server_config::overload_response },
+  { "retry_after", &server_config::retry_after },
+  { "router_config_path", &server_config::router_config_path },
+  { "precompress", &server_config::precompress },
+  { "watch_files", &server_config::watch_files },
+  { "stream_threshold", &server_config::stream_threshold, 1 },
+  { "domain", &server_config::domain },
+  { "client_timeout", &server_config::client_timeout, 1000 },
+  { "keep_alive_timeout", &server_config::keep_alive_timeout },
+  { "keep_alive_max_requests", &server_config::keep_alive_max_requests, 1 },
+  { "max_request_head", &server_config::max_request_head, 256, 1048576 },
+  { "max_request_headers", &server_config::max_request_headers, 1, 10000 },
+  { "status_cache_ms", &server_config::status_cache, 0, 60000, milliseconds(1) },
+  { "http2", &server_config::http2 },
+  { "http2_max_streams", &server_config::http2_max_streams, 1, 10000 },
+  { "log_max_size", &server_config::log_max_size }, // 0 = never rotate
+  { "log_max_segments", &server_config::log_max_segments, 0, 1000 },
+  { "log_flush_interval", &server_config::log_flush_interval, 1, 60000, milliseconds(1) },
+  { "ssl_cert_path", &server_config::ssl_cert_path },
+  { "ssl_key_path", &server_config::ssl_key_path },
+  { "ktls", &server_config::ktls },
+  { "ssl_session_cache_size", &server_config::ssl_session_cache_size, 0, 10000000 },
+  { "ssl_session_timeout", &server_config::ssl_session_timeout, 1000 },
+  { "ssl_session_tickets", &server_config::ssl_session_tickets },
+  { "ssl_ticket_key_rotation", &server_config::ssl_ticket_key_rotation, 60000 },
+  { "rate_limit_time_window", &server_config::rate_limit_time_window, 1000 },
+  { "rate_limit_max_requests", &server_config::rate_limit_max_requests, 1 },
+  { "rate_limit_ipv4_prefix", &server_config::rate_limit_ipv4_prefix, 0, 32 },
+  { "rate_limit_ipv6_prefix", &server_config::rate_limit_ipv6_prefix, 0, 128 },
+  { "ip_log_cull_threshold", &server_config::ip_log_cull_threshold, 1000 },
+  { "ip_snapshot_interval", &server_config::ip_snapshot_interval, 1000 },
+};
+
+// Strip surrounding spaces, tabs and a trailing carriage return
+static std::string_view trim(std::string_view text) {
+  size_t first = text.find_first_not_of(" \t\r");
+  if (first == std::string_view::npos)
+    return {};
+
+  size_t last = text.find_last_not_of(" \t\r");
+  return text.substr(first, last - first + 1);
+}
+
+static bool iequals(std::string_view a, std::string_view b) {
+  return a.length() == b.length() && strncasecmp(a.data(), b.data(), a.length()) == 0;
+}
+
+// Leading decimal digits of text, whatever follows them is returned in suffix
+static bool parse_number(std::string_view text, unsigned long long &number, std::string_view &suffix) {
+  auto [end, error] = std::from_chars(text.data(), text.data() + text.length(), number);
+  if (error != std::errc() || end == text.data())
+    return false;
+
+  suffix = trim(text.substr(end - text.data()));
+  return true;
+}
+
+// "500ms", "10s", "5m", "1h", "2d", or a bare number in bare_unit
+bool parse_duration(std::string_view text, milliseconds bare_unit, milliseconds &duration) {
+  unsigned long long number;
+  std::string_view suffix;
+  if (!parse_number(text, number, suffix))
+    return false;
+
+  long long unit;
+  if (suffix.empty())       unit = bare_unit.count();
+  else if (iequals(suffix, "ms")) unit = 1;
+  else if (iequals(suffix, "s"))  unit = 1000;
+  else if (iequals(suffix, "m"))  unit = 60 * 1000;
+  else if (iequals(suffix, "h"))  unit = 60 * 60 * 1000;
+  else if (iequals(suffix, "d"))  unit = 24 * 60 * 60 * 1000;
+  else return false;
+
+  if (number > static_cast<unsigned long long>(LLONG_MAX / unit))
+    return false;
+
+  duration = milliseconds(static_cast<long long>(number * unit));
+  return true;
+}
+
+// "8192", "512K", "50MB", "1GiB", multiples are powers of 1024
+bool parse_size(std::string_view text, size_t &size) {
+  unsigned long long number;
+  std::string_view suffix;
+  if (!parse_number(text, number, suffix))
+    return false;
+
+  // accept K, KB and KiB alike
+  if (suffix.length() == 3 && (suffix[1] == 'i' || suffix[1] == 'I') && (suffix[2] == 'b' || suffix[2] == 'B'))
+    suffix.remove_suffix(2);
+  else if (suffix.length() == 2 && (suffix[1] == 'b' || suffix[1] == 'B'))
+    suffix.remove_suffix(1);
+
+  int shift;
+  if (suffix.empty() || iequals(suffix, "b")) shift = 0;
+  else if (iequals(suffix, "k")) shift = 10;
+  else if (iequals(suffix, "m")) shift = 20;
+  else if (iequals(suffix, "g")) shift = 30;
+  else return false;
+
+  if (number > (static_cast<unsigned long long>(LLONG_MAX) >> shift))
+    return false;
+
+  size = static_cast<size_t>(number << shift);
+  return true;
+}
+
+// Store value in the member key describes, or explain in reason why it does not fit
+static bool assign(const config_key &key, std::string_view value, server_config &config, std::string &reason) {
+  auto out_of_range = [&](const char *unit) {
+    if (key.max == LLONG_MAX)
+      reason = "must be at least " + std::to_string(key.min) + unit;
+    else
+      reason = "must be between " + std::to_string(key.min) + unit + " and " + std::to_string(key.max) + unit;
+    return false;
+  };
+
+  return std::visit([&](auto field) {
+    using field_type = std::remove_reference_t<decltype(config.*field)>;
+
+    if constexpr (std::is_same_v<field_type, std::string>) {
+      config.*field = std::string(value);
+    } else if constexpr (std::is_same_v<field_type, bool>) {
+      if (value == "1" || iequals(value, "true") || iequals(value, "yes") || iequals(value, "on")) {
+        config.*field = true;
+      } else if (value == "0" || iequals(value, "false") || iequals(value, "no") || iequals(value, "off")) {
+        config.*field = false;
+      } else {
+        reason = "expected 1 or 0";
+        return false;
+      }
+    } else if constexpr (std::is_same_v<field_type, int>) {
+      unsigned long long number;
+      std::string_view suffix;
+      if (!parse_number(value, number, suffix) || !suffix.empty()) {
+        reason = "expected a whole number";
+        return false;
+      }
+      if (number < static_cast<unsigned long long>(key.min) || number > static_cast<unsigned long long>(std::min<long long>(key.max, INT_MAX)))
+        return out_of_range("");
+      config.*field = static_cast<int>(number);
+    } else if constexpr (std::is_same_v<field_type, size_t>) {
+      size_t size;
+      if (!parse_size(value, size)) {
+        reason = "expected a size such as 8192, 512K or 50MB";
+        return false;
+      }
+      if (size < static_cast<size_t>(key.min) || size > static_cast<size_t>(key.max))
+        return out_of_range(" bytes");
+      config.*field = size;
+    } else if constexpr (std::is_same_v<field_type, milliseconds>) {
+      milliseconds duration;
+      if (!parse_duration(value, key.unit, duration)) {
+        reason = "expected a duration such as 500ms, 10s or 5m";
+        return false;
+      }
+      if (duration.count() < key.min || duration.count() > key.max)
+        return out_of_range("ms");
+      config.*field = duration;
+    } else if constexpr (std::is_same_v<field_type, io_engine_type>) {
+      if (iequals(value, "pool")) {
+        config.*field = io_engine_type::pool;
+      } else if (iequals(value, "reactor")) {
+        config.*field = io_engine_type::reactor;
+      } else {
+        reason = "expected pool or reactor";
+        return false;
+      }
+    } else if constexpr (std::is_same_v<field_type, overload_action>) {
+      if (iequals(value, "close")) {
+        config.*field = overload_action::close;
+      } else if (value == "503") {
+        config.*field = overload_action::unavailable;
+      } else {
+        reason = "expected close or 503";
+        return false;
+      }
+    }
+    return true;
+  }, key.field);
+}
+
+bool parse_config(std::istream &input, server_config &config, std::vector<std::string> &errors, std::vector<std::string> &warnings) {
+  size_t previous_errors = errors.size();
+  std::string line;
+  int line_number = 0;
+
+  while (std::getline(input, line)) {
+    ++line_number;
+
+    // a # at the start of a line or after whitespace starts a comment
+    std::string_view text = line;
+    size_t comment = text.find('#');
+    while (comment != std::string_view::npos && comment > 0 && text[comment - 1] != ' ' && text[comment - 1] != '\t')
+      comment = text.find('#', comment + 1);
+    text = trim(text.substr(0, comment));
+    if (text.empty())
+      continue;
+
+    // Parse the line: key=value
+    size_t equals = text.find('=');
+    if (equals == std::string_view::npos) {
+      errors.push_back("line " + std::to_string(line_number) + ": expected key=value");
+      continue;
+    }
+
+    std::string_view name = trim(text.substr(0, equals)), value = trim(text.substr(equals + 1));
+    const config_key *key = nullptr;
+    for (const config_key &candidate : schema) {
+      if (name == candidate.name) {
+        key = &candidate;
+        break;
+      }
+    }
+
+    if (!key) {
+      warnings.push_back("line " + std::to_string(line_number) + ": unknown key " + std::string(name) + ", ignored");
+      continue;
+    }
+
+    std::string reason;
+    if (!assign(*key, value, config, reason))
+      errors.push_back("line " + std::to_string(line_number) + ": " + std::string(name) + "=" + std::string(value) + " " + reason);
+  }
+
+  return errors.size() == previous_errors;
+}
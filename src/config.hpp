@@ -0,0 +1,75 @@
+#ifndef __CONFIG_HPP__
+#define __CONFIG_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <istream>
+#include <cstddef>
+
+enum class io_engine_type { pool, reactor };
+enum class overload_action { close, unavailable }; // unavailable answers shed connections with 503
+
+// Every setting of secure-serve.conf, parsed and validated once. Members hold the defaults used
+// when a key is absent. Durations accept ms, s, m, h and d suffixes and sizes K, M and G
+// (powers of 1024, with or without B), a bare number is in the unit the key has always used.
+struct server_config {
+  // Server
+  int server_port = 443;
+  int backlog = 1000;
+  int listener_threads = 1; // 0 = one per core
+  io_engine_type io_engine = io_engine_type::pool;
+  int thread_pool_size = 0; // 0 = one per core
+  int reactor_threads = 0; // 0 = one per core
+  int max_queue_depth = 1024; // 0 = unbounded
+  std::chrono::milliseconds max_queue_wait{2000}; // key max_queue_wait_ms, 0 = no limit
+  overload_action overload_response = overload_action::close;
+  std::chrono::milliseconds retry_after{5000};
+  std::string router_config_path = "./public/endpoints.conf";
+  bool precompress = true;
+  bool watch_files = true;
+  size_t stream_threshold = 1048576;
+  std::string domain;
+  std::chrono::milliseconds client_timeout{10000};
+  std::chrono::milliseconds keep_alive_timeout{5000};
+  int keep_alive_max_requests = 100;
+  size_t max_request_head = 8192;
+  int max_request_headers = 100;
+  std::chrono::milliseconds status_cache{0}; // key status_cache_ms, how long /status counters may be reused, 0 = never
+  bool http2 = true; // offer h2 in ALPN, HTTP/1.1 is always offered
+  int http2_max_streams = 100; // concurrent streams per HTTP/2 connection
+
+  // Logging
+  size_t log_max_size = 52428800;
+  int log_max_segments = 5;
+  std::chrono::milliseconds log_flush_interval{100};
+
+  // TLS
+  std::string ssl_cert_path = "./secret/server.crt";
+  std::string ssl_key_path = "./secret/server.key";
+  bool ktls = false;
+  int ssl_session_cache_size = 20480; // sessions kept for resumption, 0 = no server-side cache
+  std::chrono::milliseconds ssl_session_timeout{7200000}; // how long a session or ticket can be resumed
+  bool ssl_session_tickets = true;
+  std::chrono::milliseconds ssl_ticket_key_rotation{3600000}; // a new ticket sealing key this often
+
+  // Rate limiting and the IP table
+  std::chrono::milliseconds rate_limit_time_window{60000};
+  int rate_limit_max_requests = 100;
+  int rate_limit_ipv4_prefix = 32;
+  int rate_limit_ipv6_prefix = 64;
+  std::chrono::milliseconds ip_log_cull_threshold{3600000};
+  std::chrono::milliseconds ip_snapshot_interval{60000};
+};
+
+// Read key=value lines into config, keys not in the file keep their defaults. Invalid values are
+// described in errors (with their line number) and leave the default in place, unknown keys are
+// only warned about. Returns false if there were errors.
+bool parse_config(std::istream &input, server_config &config, std::vector<std::string> &errors, std::vector<std::string> &warnings);
+
+// Unit parsing used for config values, both return false on malformed input or overflow
+bool parse_duration(std::string_view text, std::chrono::milliseconds bare_unit, std::chrono::milliseconds &duration);
+bool parse_size(std::string_view text, size_t &size);
+
+#endif
@@ -0,0 +1,341 @@
+#include "hpack.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#define STATIC_TABLE_SIZE 61
+#define ENTRY_OVERHEAD 32
+#define MAX_ENCODER_TABLE 4096
+
+
+static const hpack_table::entry static_table[STATIC_TABLE_SIZE] = {
+  { ":authority", "" }, { ":method", "GET" }, { ":method", "POST" }, { ":path", "/" },
+  { ":path", "/index.html" }, { ":scheme", "http" }, { ":scheme", "https" }, { ":status", "200" },
+  { ":status", "204" }, { ":status", "206" }, { ":status", "304" }, { ":status", "400" },
+  { ":status", "404" }, { ":status", "500" }, { "accept-charset", "" }, { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" }, { "accept-ranges", "" }, { "accept", "" }, { "access-control-allow-origin", "" },
+  { "age", "" }, { "allow", "" }, { "authorization", "" }, { "cache-control", "" },
+  { "content-disposition", "" }, { "content-encoding", "" }, { "content-language", "" }, { "content-length", "" },
+  { "content-location", "" }, { "content-range", "" }, { "content-type", "" }, { "cookie", "" },
+  { "date", "" }, { "etag", "" }, { "expect", "" }, { "expires", "" },
+  { "from", "" }, { "host", "" }, { "if-match", "" }, { "if-modified-since", "" },
+  { "if-none-match", "" }, { "if-range", "" }, { "if-unmodified-since", "" }, { "last-modified", "" },
+  { "link", "" }, { "location", "" }, { "max-forwards", "" }, { "proxy-authenticate", "" },
+  { "proxy-authorization", "" }, { "range", "" }, { "referer", "" }, { "refresh", "" },
+  { "retry-after", "" }, { "server", "" }, { "set-cookie", "" }, { "strict-transport-security", "" },
+  { "transfer-encoding", "" }, { "user-agent", "" }, { "vary", "" }, { "via", "" },
+  { "www-authenticate", "" },
+};
+
+// Code length of every symbol in the HPACK Huffman code, 256 is EOS. The code is canonical, so
+// the codes themselves follow from the lengths.
+static const uint8_t huffman_lengths[257] = {
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+  5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+  13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+  15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+  6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30,
+};
+
+// Canonical decoding tables: per code length, the first code, how many codes have it and where
+// their symbols start in symbols, which is ordered by length then value
+struct huffman_decoding {
+  static constexpr int max_length = 30;
+
+  uint32_t first[max_length + 1] = {};
+  uint16_t count[max_length + 1] = {};
+  uint16_t start[max_length + 1] = {};
+  uint16_t symbols[257];
+
+  huffman_decoding() {
+    for (int symbol = 0; symbol < 257; ++symbol) {
+      count[huffman_lengths[symbol]]++;
+    }
+
+    uint32_t code = 0;
+    uint16_t position = 0;
+    for (int length = 1; length <= max_length; ++length) {
+      code = (code + count[length - 1]) << 1;
+      first[length] = code;
+      start[length] = position;
+      position += count[length];
+    }
+    first[1] = 0;
+
+    uint16_t filled[max_length + 1] = {};
+    for (int symbol = 0; symbol < 257; ++symbol) {
+      int length = huffman_lengths[symbol];
+      symbols[start[length] + filled[length]++] = symbol;
+    }
+  }
+};
+
+static const huffman_decoding huffman;
+
+// Decode a Huffman coded string. Padding must be fewer than 8 bits, all ones, and EOS never appears.
+static bool huffman_decode(std::string_view in, std::string &out) {
+  uint32_t code = 0;
+  int length = 0;
+
+  for (unsigned char byte : in) {
+    for (int bit = 7; bit >= 0; --bit) {
+      code = (code << 1) | ((byte >> bit) & 1);
+      length++;
+
+      uint32_t offset = code - huffman.first[length];
+      if (code >= huffman.first[length] && offset < huffman.count[length]) {
+        uint16_t symbol = huffman.symbols[huffman.start[length] + offset];
+        if (symbol == 256)
+          return false;
+
+        out += static_cast<char>(symbol);
+        code = 0;
+        length = 0;
+      } else if (length == huffman_decoding::max_length) {
+        return false;
+      }
+    }
+  }
+
+  return length < 8 && code == (1u << length) - 1;
+}
+
+// Decode an integer with an N-bit prefix (RFC 7541 section 5.1)
+static bool decode_integer(std::string_view block, size_t &pos, int prefix_bits, size_t &value) {
+  if (pos >= block.size())
+    return false;
+
+  size_t limit = (1u << prefix_bits) - 1;
+  value = static_cast<unsigned char>(block[pos++]) & limit;
+  if (value < limit)
+    return true;
+
+  for (int shift = 0; pos < block.size(); shift += 7) {
+    if (shift > 28)
+      return false; // more than any table index or string length could need
+
+    unsigned char byte = block[pos++];
+    value += static_cast<size_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+static bool decode_string(std::string_view block, size_t &pos, std::string &out) {
+  if (pos >= block.size())
+    return false;
+
+  bool huffman_coded = block[pos] & 0x80;
+  size_t length;
+  if (!decode_integer(block, pos, 7, length) || length > block.size() - pos)
+    return false;
+
+  std::string_view raw = block.substr(pos, length);
+  pos += length;
+
+  out.clear();
+  if (!huffman_coded) {
+    out.assign(raw);
+    return true;
+  }
+  return huffman_decode(raw, out);
+}
+
+static void encode_integer(std::string &out, unsigned char first_bits, int prefix_bits, size_t value) {
+  size_t limit = (1u << prefix_bits) - 1;
+  if (value < limit) {
+    out += static_cast<char>(first_bits | value);
+    return;
+  }
+
+  out += static_cast<char>(first_bits | limit);
+  value -= limit;
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+// Strings go out as plain octets, response fields are mostly tokens and digits Huffman would barely shrink
+static void encode_string(std::string &out, std::string_view text) {
+  encode_integer(out, 0x00, 7, text.size());
+  out.append(text);
+}
+
+
+/*************************************
+ * hpack_table
+**************************************/
+
+const hpack_table::entry *hpack_table::get(size_t index) const {
+  if (index == 0)
+    return nullptr;
+  if (index <= STATIC_TABLE_SIZE)
+    return &static_table[index - 1];
+  if (index - STATIC_TABLE_SIZE <= this->entries.size())
+    return &this->entries[index - STATIC_TABLE_SIZE - 1];
+  return nullptr;
+}
+
+size_t hpack_table::find(std::string_view name, std::string_view value, size_t &name_index) const {
+  name_index = 0;
+
+  for (size_t i = 0; i < STATIC_TABLE_SIZE; ++i) {
+    if (static_table[i].name == name) {
+      if (static_table[i].value == value)
+        return i + 1;
+      if (name_index == 0)
+        name_index = i + 1;
+    }
+  }
+
+  for (size_t i = 0; i < this->entries.size(); ++i) {
+    if (this->entries[i].name == name) {
+      if (this->entries[i].value == value)
+        return STATIC_TABLE_SIZE + i + 1;
+      if (name_index == 0)
+        name_index = STATIC_TABLE_SIZE + i + 1;
+    }
+  }
+
+  return 0;
+}
+
+// An entry larger than the whole table empties it and is not added (RFC 7541 section 4.4)
+void hpack_table::add(std::string_view name, std::string_view value) {
+  size_t needed = name.size() + value.size() + ENTRY_OVERHEAD;
+  this->evict(needed);
+  if (needed > this->max_size)
+    return;
+
+  this->entries.push_front({ std::string(name), std::string(value) });
+  this->size += needed;
+}
+
+void hpack_table::resize(size_t size) {
+  this->max_size = size;
+  this->evict(0);
+}
+
+void hpack_table::evict(size_t needed) {
+  while (!this->entries.empty() && this->size + needed > this->max_size) {
+    const entry &oldest = this->entries.back();
+    this->size -= oldest.name.size() + oldest.value.size() + ENTRY_OVERHEAD;
+    this->entries.pop_back();
+  }
+}
+
+
+/*************************************
+ * hpack_decoder
+**************************************/
+
+hpack_decoder::hpack_decoder(size_t max_table_size, size_t max_list_size)
+    : table(max_table_size), max_table_size(max_table_size), max_list_size(max_list_size) {}
+
+hpack_decoder::status hpack_decoder::decode(std::string_view block, header_list &headers) {
+  size_t pos = 0, list_size = 0;
+  bool fields_seen = false, too_large = false;
+  std::string name, value;
+
+  while (pos < block.size()) {
+    unsigned char first = block[pos];
+    size_t index;
+
+    if (first & 0x80) { // indexed field
+      if (!decode_integer(block, pos, 7, index))
+        return status::error;
+      const hpack_table::entry *found = this->table.get(index);
+      if (!found)
+        return status::error;
+      name = found->name;
+      value = found->value;
+    } else if ((first & 0xe0) == 0x20) { // dynamic table size update, only before the first field
+      if (fields_seen || !decode_integer(block, pos, 5, index) || index > this->max_table_size)
+        return status::error;
+      this->table.resize(index);
+      continue;
+    } else { // literal, with incremental indexing (01), without (0000) or never indexed (0001)
+      bool indexing = (first & 0xc0) == 0x40;
+      if (!decode_integer(block, pos, indexing ? 6 : 4, index))
+        return status::error;
+
+      if (index == 0) {
+        if (!decode_string(block, pos, name))
+          return status::error;
+      } else {
+        const hpack_table::entry *found = this->table.get(index);
+        if (!found)
+          return status::error;
+        name = found->name;
+      }
+
+      if (!decode_string(block, pos, value))
+        return status::error;
+      if (indexing)
+        this->table.add(name, value);
+    }
+
+    fields_seen = true;
+    list_size += name.size() + value.size() + ENTRY_OVERHEAD;
+    if (list_size > this->max_list_size)
+      too_large = true;
+    if (!too_large)
+      headers.emplace_back(name, value);
+  }
+
+  return too_large ? status::too_large : status::ok;
+}
+
+
+/*************************************
+ * hpack_encoder
+**************************************/
+
+void hpack_encoder::set_max_table_size(size_t size) {
+  size = std::min<size_t>(size, MAX_ENCODER_TABLE);
+  if (size != this->table.get_max_size()) {
+    this->table.resize(size);
+    this->size_update = true;
+  }
+}
+
+void hpack_encoder::encode(std::string &out, std::string_view name, std::string_view value, bool index) {
+  if (this->size_update) {
+    encode_integer(out, 0x20, 5, this->table.get_max_size());
+    this->size_update = false;
+  }
+
+  size_t name_index;
+  size_t found = this->table.find(name, value, name_index);
+  if (found) {
+    encode_integer(out, 0x80, 7, found);
+    return;
+  }
+
+  if (index) {
+    encode_integer(out, 0x40, 6, name_index);
+    this->table.add(name, value);
+  } else {
+    encode_integer(out, 0x00, 4, name_index);
+  }
+
+  if (name_index == 0)
+    encode_string(out, name);
+  encode_string(out, value);
+}
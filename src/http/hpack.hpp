@@ -0,0 +1,68 @@
+#ifndef __HPACK_HPP__
+#define __HPACK_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cstddef>
+
+// HPACK (RFC 7541) header compression for HTTP/2. Each direction of a connection has its own
+// dynamic table, kept in step by decoding every header block in the order it was sent.
+
+// Static table followed by the connection's dynamic table, newest entry first
+class hpack_table {
+  public:
+    struct entry {
+      std::string name, value;
+    };
+
+    explicit hpack_table(size_t max_size) : max_size(max_size) {}
+
+    const entry *get(size_t index) const; // 1-based over both tables, nullptr when out of range
+    // Index of an exact match, 0 if none; name_index gets the first entry with the same name, 0 if none
+    size_t find(std::string_view name, std::string_view value, size_t &name_index) const;
+    void add(std::string_view name, std::string_view value); // evicts the oldest entries to make room
+    void resize(size_t size);
+    size_t get_max_size() const { return max_size; }
+  private:
+    void evict(size_t needed);
+
+    std::deque<entry> entries;
+    size_t size = 0; // RFC 7541 size: name and value lengths plus 32 per entry
+    size_t max_size;
+};
+
+class hpack_decoder {
+  public:
+    using header_list = std::vector<std::pair<std::string, std::string>>;
+    enum class status { ok, too_large, error };
+
+    // max_table_size is the SETTINGS_HEADER_TABLE_SIZE advertised to the peer, max_list_size caps
+    // the decoded names and values of one block so a small block cannot expand without bound
+    hpack_decoder(size_t max_table_size, size_t max_list_size);
+
+    // Decode one complete header block onto headers. too_large means the block was decoded, keeping
+    // the table in step, but its fields were dropped. error is a COMPRESSION_ERROR for the connection.
+    status decode(std::string_view block, header_list &headers);
+  private:
+    hpack_table table;
+    size_t max_table_size, max_list_size;
+};
+
+class hpack_encoder {
+  public:
+    hpack_encoder() : table(4096) {}
+
+    // The peer's SETTINGS_HEADER_TABLE_SIZE, announced at the start of the next block
+    void set_max_table_size(size_t size);
+    // Append one field, name already lowercase. Fields with index set are added to the dynamic
+    // table so they cost a byte or two when repeated on later responses.
+    void encode(std::string &out, std::string_view name, std::string_view value, bool index = true);
+  private:
+    hpack_table table;
+    bool size_update = false; // a table size update is owed at the start of the next block
+};
+
+#endif
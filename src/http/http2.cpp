@@ -0,0 +1,554 @@
+#include "http2.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+#define CLIENT_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define FRAME_HEADER_SIZE 9
+#define DEFAULT_MAX_FRAME 16384 // what this side accepts, never raised
+#define MAX_WINDOW 0x7fffffff
+#define FLUSH_BUDGET 262144 // DATA bytes queued per call, the rest follows once they are written
+
+enum frame_type : uint8_t {
+  DATA = 0x0, HEADERS = 0x1, PRIORITY = 0x2, RST_STREAM = 0x3, SETTINGS = 0x4,
+  PUSH_PROMISE = 0x5, PING = 0x6, GOAWAY = 0x7, WINDOW_UPDATE = 0x8, CONTINUATION = 0x9
+};
+
+enum frame_flag : uint8_t {
+  END_STREAM = 0x1, ACK = 0x1, END_HEADERS = 0x4, PADDED = 0x8, PRIORITY_FLAG = 0x20
+};
+
+enum error_code : uint32_t {
+  NO_ERROR = 0x0, PROTOCOL_ERROR = 0x1, INTERNAL_ERROR = 0x2, FLOW_CONTROL_ERROR = 0x3,
+  FRAME_SIZE_ERROR = 0x6, REFUSED_STREAM = 0x7, COMPRESSION_ERROR = 0x9
+};
+
+enum setting_id : uint16_t {
+  HEADER_TABLE_SIZE = 0x1, ENABLE_PUSH = 0x2, MAX_CONCURRENT_STREAMS = 0x3, INITIAL_WINDOW_SIZE = 0x4,
+  MAX_FRAME_SIZE = 0x5, MAX_HEADER_LIST_SIZE = 0x6
+};
+
+
+static uint32_t read_u32(const char *p) {
+  const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+  return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | u[3];
+}
+
+static void write_u32(char *p, uint32_t value) {
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+static void append_frame_header(output_queue &out, size_t length, uint8_t type, uint8_t flags, uint32_t id) {
+  char header[FRAME_HEADER_SIZE];
+  header[0] = length >> 16;
+  header[1] = length >> 8;
+  header[2] = length;
+  header[3] = type;
+  header[4] = flags;
+  write_u32(header + 5, id & MAX_WINDOW);
+  out.append(std::string_view(header, sizeof(header)));
+}
+
+// A frame whose payload is one or two 32-bit words: RST_STREAM, WINDOW_UPDATE, GOAWAY
+static void append_word_frame(output_queue &out, uint8_t type, uint32_t id, uint32_t first, int words = 1, uint32_t second = 0) {
+  char payload[8];
+  write_u32(payload, first);
+  write_u32(payload + 4, second);
+  append_frame_header(out, words * 4, type, 0, id);
+  out.append(std::string_view(payload, words * 4));
+}
+
+// Connection-specific fields have no meaning in HTTP/2 and make a request malformed (RFC 9113 section 8.2.2)
+static bool is_connection_specific(std::string_view name) {
+  return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+         name == "transfer-encoding" || name == "upgrade";
+}
+
+
+http2_session::http2_session(const settings &local)
+    : local(local), decoder(4096, local.max_header_list_size) {}
+
+bool http2_session::can_send() const {
+  if (this->send_window <= 0)
+    return false;
+
+  for (const stream &each : this->streams) {
+    if (each.window > 0)
+      return true;
+  }
+  return false;
+}
+
+http2_session::stream *http2_session::find(uint32_t id) {
+  for (stream &each : this->streams) {
+    if (each.id == id)
+      return &each;
+  }
+  return nullptr;
+}
+
+bool http2_session::process(std::string &input, output_queue &out, responder &respond) {
+  if (this->failed)
+    return false;
+
+  // the server's preface, may go out before the client's has arrived
+  if (!this->preface_sent) {
+    char payload[12];
+    payload[0] = 0;
+    payload[1] = MAX_CONCURRENT_STREAMS;
+    write_u32(payload + 2, this->local.max_concurrent_streams);
+    payload[6] = 0;
+    payload[7] = MAX_HEADER_LIST_SIZE;
+    write_u32(payload + 8, this->local.max_header_list_size);
+    append_frame_header(out, sizeof(payload), SETTINGS, 0, 0);
+    out.append(std::string_view(payload, sizeof(payload)));
+    this->preface_sent = true;
+  }
+
+  size_t consumed = 0;
+  if (!this->preface_received) {
+    size_t length = std::min(input.size(), strlen(CLIENT_PREFACE));
+    if (input.compare(0, length, CLIENT_PREFACE, length) != 0) {
+      input.clear();
+      return this->fail(PROTOCOL_ERROR, out);
+    }
+    if (length < strlen(CLIENT_PREFACE))
+      return true;
+
+    consumed = length;
+    this->preface_received = true;
+  }
+
+  while (!this->failed && input.size() - consumed >= FRAME_HEADER_SIZE) {
+    const unsigned char *header = reinterpret_cast<const unsigned char *>(input.data() + consumed);
+    size_t length = (size_t(header[0]) << 16) | (size_t(header[1]) << 8) | header[2];
+    uint8_t type = header[3], flags = header[4];
+    uint32_t id = read_u32(input.data() + consumed + 5) & MAX_WINDOW;
+
+    if (length > DEFAULT_MAX_FRAME) {
+      this->fail(FRAME_SIZE_ERROR, out);
+      break;
+    }
+    if (input.size() - consumed < FRAME_HEADER_SIZE + length)
+      break;
+
+    std::string_view payload(input.data() + consumed + FRAME_HEADER_SIZE, length);
+    consumed += FRAME_HEADER_SIZE + length;
+    this->handle_frame(type, flags, id, payload, out, respond);
+  }
+
+  if (this->failed) {
+    input.clear();
+    return false;
+  }
+  input.erase(0, consumed);
+
+  if (this->going_away && !this->goaway_sent) {
+    append_word_frame(out, GOAWAY, 0, this->last_stream_id, 2, NO_ERROR);
+    this->goaway_sent = true;
+  }
+
+  this->send_data(out);
+  return !((this->goaway_sent || this->peer_going_away) && this->streams.empty() && this->continuation_stream == 0);
+}
+
+// Returns false after a connection error
+bool http2_session::handle_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload, output_queue &out, responder &respond) {
+  // the first frame must be SETTINGS, and nothing may come between a header block's frames
+  if (!this->settings_received && type != SETTINGS)
+    return this->fail(PROTOCOL_ERROR, out);
+  if (this->continuation_stream != 0 && (type != CONTINUATION || id != this->continuation_stream))
+    return this->fail(PROTOCOL_ERROR, out);
+
+  size_t flow_controlled = payload.size(); // DATA counts against the window with its padding
+
+  // strip padding from the frames that may carry it
+  if ((type == DATA || type == HEADERS) && (flags & PADDED)) {
+    if (payload.empty() || static_cast<unsigned char>(payload[0]) >= payload.size())
+      return this->fail(PROTOCOL_ERROR, out);
+    payload = payload.substr(1, payload.size() - 1 - static_cast<unsigned char>(payload[0]));
+  }
+
+  switch (type) {
+    case SETTINGS:
+      return this->handle_settings(flags, id, payload, out);
+
+    case HEADERS:
+      if (id == 0 || id % 2 == 0)
+        return this->fail(PROTOCOL_ERROR, out);
+      if (flags & PRIORITY_FLAG) {
+        if (payload.size() < 5)
+          return this->fail(PROTOCOL_ERROR, out);
+        payload.remove_prefix(5); // stream priorities are advisory and not used
+      }
+
+      this->header_block.assign(payload);
+      if (!(flags & END_HEADERS)) {
+        this->continuation_stream = id;
+        this->continuation_end_stream = flags & END_STREAM;
+        return true;
+      }
+      return this->handle_headers(id, flags & END_STREAM, out, respond);
+
+    case CONTINUATION:
+      if (id == 0 || id != this->continuation_stream)
+        return this->fail(PROTOCOL_ERROR, out);
+      if (this->header_block.size() + payload.size() > this->local.max_header_list_size)
+        return this->fail(PROTOCOL_ERROR, out); // compressed, the block can only be smaller than what it decodes to
+
+      this->header_block.append(payload);
+      if (!(flags & END_HEADERS))
+        return true;
+      this->continuation_stream = 0;
+      return this->handle_headers(id, this->continuation_end_stream, out, respond);
+
+    case DATA:
+      // request bodies are not used, but the bytes still count against the connection window
+      if (id == 0 || id > this->highest_stream_id)
+        return this->fail(PROTOCOL_ERROR, out);
+      if (flow_controlled > 0)
+        append_word_frame(out, WINDOW_UPDATE, 0, flow_controlled);
+      if (flags & END_STREAM) {
+        if (stream *finished = this->find(id))
+          finished->reset_after = false; // the body is complete, a reset would hit a closed stream
+      }
+      return true;
+
+    case WINDOW_UPDATE:
+      return this->handle_window_update(id, payload, out);
+
+    case PING:
+      if (id != 0)
+        return this->fail(PROTOCOL_ERROR, out);
+      if (payload.size() != 8)
+        return this->fail(FRAME_SIZE_ERROR, out);
+      if (!(flags & ACK)) {
+        append_frame_header(out, 8, PING, ACK, 0);
+        out.append(payload);
+      }
+      return true;
+
+    case RST_STREAM:
+      if (id == 0 || id > this->highest_stream_id)
+        return this->fail(PROTOCOL_ERROR, out);
+      if (payload.size() != 4)
+        return this->fail(FRAME_SIZE_ERROR, out);
+      if (stream *cancelled = this->find(id))
+        this->streams.erase(this->streams.begin() + (cancelled - this->streams.data()));
+      return true;
+
+    case PRIORITY:
+      if (id == 0)
+        return this->fail(PROTOCOL_ERROR, out);
+      if (payload.size() != 5)
+        this->reset(id, FRAME_SIZE_ERROR, out);
+      return true;
+
+    case GOAWAY:
+      if (id != 0)
+        return this->fail(PROTOCOL_ERROR, out);
+      this->peer_going_away = true; // the streams already answered are still sent
+      return true;
+
+    case PUSH_PROMISE:
+      return this->fail(PROTOCOL_ERROR, out); // only servers push
+
+    default:
+      return true; // unknown frame types are ignored
+  }
+}
+
+bool http2_session::handle_settings(uint8_t flags, uint32_t id, std::string_view payload, output_queue &out) {
+  if (id != 0)
+    return this->fail(PROTOCOL_ERROR, out);
+  if (flags & ACK)
+    return payload.empty() ? true : this->fail(FRAME_SIZE_ERROR, out);
+  if (payload.size() % 6 != 0)
+    return this->fail(FRAME_SIZE_ERROR, out);
+
+  for (size_t pos = 0; pos < payload.size(); pos += 6) {
+    uint16_t setting = (uint16_t(static_cast<unsigned char>(payload[pos])) << 8) | static_cast<unsigned char>(payload[pos + 1]);
+    uint32_t value = read_u32(payload.data() + pos + 2);
+
+    switch (setting) {
+      case HEADER_TABLE_SIZE:
+        this->encoder.set_max_table_size(value);
+        break;
+      case ENABLE_PUSH:
+        if (value > 1)
+          return this->fail(PROTOCOL_ERROR, out);
+        break;
+      case INITIAL_WINDOW_SIZE: {
+        if (value > MAX_WINDOW)
+          return this->fail(FLOW_CONTROL_ERROR, out);
+
+        // applies to every open stream, and may leave a window negative
+        int64_t delta = int64_t(value) - this->initial_window;
+        for (stream &each : this->streams) {
+          each.window += delta;
+          if (each.window > MAX_WINDOW)
+            return this->fail(FLOW_CONTROL_ERROR, out);
+        }
+        this->initial_window = value;
+        break;
+      }
+      case MAX_FRAME_SIZE:
+        if (value < DEFAULT_MAX_FRAME || value > 0xffffff)
+          return this->fail(PROTOCOL_ERROR, out);
+        this->max_frame = value;
+        break;
+      default:
+        break; // unknown settings are ignored
+    }
+  }
+
+  this->settings_received = true;
+  append_frame_header(out, 0, SETTINGS, ACK, 0);
+  return true;
+}
+
+bool http2_session::handle_window_update(uint32_t id, std::string_view payload, output_queue &out) {
+  if (payload.size() != 4)
+    return this->fail(FRAME_SIZE_ERROR, out);
+
+  uint32_t increment = read_u32(payload.data()) & MAX_WINDOW;
+  if (id == 0) {
+    if (increment == 0)
+      return this->fail(PROTOCOL_ERROR, out);
+    this->send_window += increment;
+    if (this->send_window > MAX_WINDOW)
+      return this->fail(FLOW_CONTROL_ERROR, out);
+    return true;
+  }
+
+  if (id > this->highest_stream_id)
+    return this->fail(PROTOCOL_ERROR, out);
+
+  stream *target = this->find(id);
+  if (!target)
+    return true; // already finished, the update crossed the last DATA frame
+  if (increment == 0 || target->window + increment > MAX_WINDOW) {
+    this->reset(id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR, out);
+    return true;
+  }
+  target->window += increment;
+  return true;
+}
+
+// A complete header block arrived in header_block. It is always decoded, even for streams that
+// are refused, since the peer's encoder already counted it into the shared table.
+bool http2_session::handle_headers(uint32_t id, bool end_stream, output_queue &out, responder &respond) {
+  this->decoded.clear();
+  hpack_decoder::status status = this->decoder.decode(this->header_block, this->decoded);
+  if (status == hpack_decoder::status::error)
+    return this->fail(COMPRESSION_ERROR, out);
+
+  if (id <= this->highest_stream_id)
+    return true; // trailers of a request already answered
+  this->highest_stream_id = id;
+  if (this->going_away)
+    return true; // past the last stream this connection takes, the client may retry it elsewhere
+
+  this->last_stream_id = id;
+
+  if (this->streams.size() >= this->local.max_concurrent_streams) {
+    this->reset(id, REFUSED_STREAM, out);
+    return true;
+  }
+
+  if (status == hpack_decoder::status::too_large) {
+    this->encoded.clear();
+    this->encoder.encode(this->encoded, ":status", "431", false);
+    this->send_headers(id, this->encoded, true, out);
+    if (!end_stream)
+      this->reset(id, NO_ERROR, out);
+    return true;
+  }
+
+  http_request request;
+  if (!this->build_request(request)) {
+    this->reset(id, PROTOCOL_ERROR, out);
+    return true;
+  }
+
+  this->respond_to(id, end_stream, request, out, respond);
+  return true;
+}
+
+// View the decoded fields as a request. Pseudo-headers come first and fill the request line,
+// the rest become ordinary headers. False if the request is malformed.
+bool http2_session::build_request(http_request &request) {
+  std::string_view scheme, authority;
+  bool regular_seen = false;
+
+  for (const auto &[name, value] : this->decoded) {
+    if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; }))
+      return false;
+
+    if (!name.empty() && name[0] == ':') {
+      if (regular_seen)
+        return false;
+
+      std::string_view *field = name == ":method" ? &request.method : name == ":path" ? &request.target :
+                                name == ":scheme" ? &scheme : name == ":authority" ? &authority : nullptr;
+      if (!field || !field->empty())
+        return false; // unknown or repeated
+      *field = value;
+      continue;
+    }
+
+    regular_seen = true;
+    if (is_connection_specific(name) || (name == "te" && value != "trailers"))
+      return false;
+    request.headers.push_back({ name, value });
+  }
+
+  if (request.method.empty() || request.target.empty() || scheme.empty())
+    return false;
+
+  if (!authority.empty() && !request.has_header("host"))
+    request.headers.push_back({ "host", authority });
+  request.version = "HTTP/2";
+  return true;
+}
+
+// Have the responder answer, then send its status and headers in a HEADERS frame and queue its
+// body to be sent in DATA frames
+void http2_session::respond_to(uint32_t id, bool end_stream, const http_request &request, output_queue &out, responder &respond) {
+  output_queue response;
+  respond(request, response);
+
+  // the status line and headers are generated text, so they sit at the front of the queue
+  std::string_view head = response.front();
+  size_t head_end = head.find("\r\n\r\n");
+  if (head.size() < 12 || head_end == std::string_view::npos) {
+    this->reset(id, INTERNAL_ERROR, out);
+    return;
+  }
+
+  this->encoded.clear();
+  this->encoder.encode(this->encoded, ":status", head.substr(9, 3));
+
+  size_t line_start = head.find("\r\n") + 2;
+  std::string name;
+  while (line_start < head_end) {
+    size_t line_end = head.find("\r\n", line_start);
+    std::string_view line = head.substr(line_start, line_end - line_start);
+    line_start = line_end + 2;
+
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos)
+      continue;
+
+    name.assign(line.substr(0, colon));
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (is_connection_specific(name))
+      continue;
+
+    // lengths and ranges change with every response, indexing them would only churn the table
+    bool index = name != "content-length" && name != "content-range";
+    this->encoder.encode(this->encoded, name, trim_whitespace(line.substr(colon + 1)), index);
+  }
+
+  response.consume(head_end + 4);
+  size_t remaining = response.size();
+  this->send_headers(id, this->encoded, remaining == 0, out);
+
+  if (remaining > 0) {
+    this->streams.push_back({ id, this->initial_window, std::move(response), remaining, !end_stream });
+  } else if (!end_stream) {
+    this->reset(id, NO_ERROR, out); // answered, the client may stop sending its body
+  }
+}
+
+// A header block too large for one frame continues in CONTINUATION frames
+void http2_session::send_headers(uint32_t id, std::string_view block, bool end_stream, output_queue &out) {
+  uint8_t type = HEADERS;
+  uint8_t flags = end_stream ? END_STREAM : 0;
+
+  do {
+    std::string_view fragment = block.substr(0, this->max_frame);
+    block.remove_prefix(fragment.size());
+
+    append_frame_header(out, fragment.size(), type, flags | (block.empty() ? END_HEADERS : 0), id);
+    out.append(fragment);
+    type = CONTINUATION;
+    flags = 0;
+  } while (!block.empty());
+}
+
+// Queue DATA frames, one per stream in turn, until the windows close or the budget is spent. The
+// payload is copied next to its frame header so a write covers whole frames rather than stopping
+// at every 9 byte header.
+void http2_session::send_data(output_queue &out) {
+  size_t queued = 0, blocked = 0;
+
+  while (!this->streams.empty() && this->send_window > 0 && queued < FLUSH_BUDGET && blocked < this->streams.size()) {
+    if (this->next_stream >= this->streams.size())
+      this->next_stream = 0;
+
+    stream &current = this->streams[this->next_stream];
+    int64_t allowed = std::min<int64_t>({ this->send_window, current.window, int64_t(this->max_frame), int64_t(current.remaining) });
+    if (allowed <= 0) {
+      blocked++;
+      this->next_stream++;
+      continue;
+    }
+    blocked = 0;
+
+    // gather the payload before framing it: a body whose file was truncated on disk cannot fill
+    // the frame, its stream is reset instead and the other streams carry on
+    this->payload.clear();
+    for (size_t left = allowed; left > 0; ) {
+      std::string_view piece = current.body.front().substr(0, left);
+      if (piece.empty())
+        break;
+      this->payload.append(piece);
+      current.body.consume(piece.size());
+      left -= piece.size();
+    }
+    if (current.body.truncated()) {
+      append_word_frame(out, RST_STREAM, current.id, INTERNAL_ERROR);
+      this->streams.erase(this->streams.begin() + this->next_stream);
+      continue;
+    }
+
+    bool last = size_t(allowed) == current.remaining;
+    append_frame_header(out, allowed, DATA, last ? END_STREAM : 0, current.id);
+    out.append(this->payload);
+
+    this->send_window -= allowed;
+    current.window -= allowed;
+    current.remaining -= allowed;
+    queued += FRAME_HEADER_SIZE + allowed;
+
+    if (last) {
+      if (current.reset_after)
+        append_word_frame(out, RST_STREAM, current.id, NO_ERROR);
+      this->streams.erase(this->streams.begin() + this->next_stream);
+    } else {
+      this->next_stream++;
+    }
+  }
+}
+
+// Stream error: abandon the stream, the connection carries on
+void http2_session::reset(uint32_t id, uint32_t code, output_queue &out) {
+  append_word_frame(out, RST_STREAM, id, code);
+  if (stream *abandoned = this->find(id))
+    this->streams.erase(this->streams.begin() + (abandoned - this->streams.data()));
+}
+
+// Connection error: say why in a GOAWAY and close once it is written. Always returns false.
+bool http2_session::fail(uint32_t code, output_queue &out) {
+  if (!this->failed)
+    append_word_frame(out, GOAWAY, 0, this->last_stream_id, 2, code);
+
+  this->failed = true;
+  this->streams.clear();
+  return false;
+}
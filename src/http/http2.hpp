@@ -0,0 +1,86 @@
+#ifndef __HTTP2_HPP__
+#define __HTTP2_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "hpack.hpp"
+#include "parser.hpp"
+#include "util/output_queue.hpp"
+#include "util/task.hpp"
+
+// Server side of one HTTP/2 connection (RFC 9113), independent of how bytes reach the socket.
+// Received bytes go in, frames to send come out on an output_queue. Every request is answered as
+// soon as its headers are complete by a responder writing an ordinary HTTP/1.1 response, which is
+// turned into a HEADERS frame and a body sent in DATA frames. Bodies of all open streams are
+// interleaved round-robin as the peer's flow control windows allow, so one large file does not
+// hold up the small ones requested next to it.
+class http2_session {
+  public:
+    struct settings {
+      uint32_t max_concurrent_streams = 100;
+      size_t max_header_list_size = 8192; // decoded request headers, larger requests get a 431
+    };
+
+    // Appends the complete HTTP/1.1 response to a request onto the queue. Bodies may be referenced,
+    // they must stay alive while has_pending() says streams are still being sent.
+    using responder = small_function<void(const http_request &, output_queue &)>;
+
+    explicit http2_session(const settings &local);
+
+    // Handle every complete frame in input, erasing them from it, then queue as many DATA frames
+    // as flow control allows onto out. Returns false once the connection is to close after out is written.
+    bool process(std::string &input, output_queue &out, responder &respond);
+    // Finish the streams already started and close, refusing new ones. The GOAWAY goes out with the next frames.
+    void go_away() { going_away = true; }
+
+    bool has_pending() const { return !streams.empty(); } // responses not yet fully queued
+    bool can_send() const; // a pending response has window to send into, process() would queue more
+  private:
+    struct stream {
+      uint32_t id;
+      int64_t window; // what the peer will still accept on this stream
+      output_queue body;
+      size_t remaining;
+      bool reset_after; // the request still has a body coming, reset the stream once answered
+    };
+
+    bool handle_frame(uint8_t type, uint8_t flags, uint32_t id, std::string_view payload, output_queue &out, responder &respond);
+    bool handle_settings(uint8_t flags, uint32_t id, std::string_view payload, output_queue &out);
+    bool handle_window_update(uint32_t id, std::string_view payload, output_queue &out);
+    bool handle_headers(uint32_t id, bool end_stream, output_queue &out, responder &respond);
+    bool build_request(http_request &request);
+    void respond_to(uint32_t id, bool end_stream, const http_request &request, output_queue &out, responder &respond);
+    void send_headers(uint32_t id, std::string_view block, bool end_stream, output_queue &out);
+    void send_data(output_queue &out);
+    void reset(uint32_t id, uint32_t code, output_queue &out);
+    bool fail(uint32_t code, output_queue &out);
+    stream *find(uint32_t id);
+
+    settings local;
+    hpack_decoder decoder;
+    hpack_encoder encoder;
+    std::vector<stream> streams; // responses with body left to send, in round-robin order
+    size_t next_stream = 0;
+
+    int64_t send_window = 65535; // connection level window the peer granted
+    int64_t initial_window = 65535; // the peer's SETTINGS_INITIAL_WINDOW_SIZE
+    size_t max_frame = 16384; // the peer's SETTINGS_MAX_FRAME_SIZE
+
+    uint32_t last_stream_id = 0; // highest stream answered or refused, what a GOAWAY reports
+    uint32_t highest_stream_id = 0; // highest stream the peer opened, including those ignored after a GOAWAY
+    uint32_t continuation_stream = 0; // stream whose header block is still arriving in CONTINUATION frames
+    bool continuation_end_stream = false;
+    std::string header_block; // the fragments received so far
+    hpack_decoder::header_list decoded;
+    std::string encoded;
+    std::string payload; // one DATA frame's body, gathered before it is framed
+
+    bool preface_sent = false, preface_received = false, settings_received = false;
+    bool going_away = false, goaway_sent = false, peer_going_away = false, failed = false;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "mime.hpp"
+
+#include <cstring>
+#include <strings.h>
+
+
+// Extensions of the formats a static site usually serves
+static const struct {
+  const char *extension, *type;
+} mime_types[] = {
+  { "html", "text/html" }, { "htm", "text/html" }, { "css", "text/css" }, { "txt", "text/plain" },
+  { "md", "text/markdown" }, { "csv", "text/csv" }, { "xml", "application/xml" },
+  { "js", "application/javascript" }, { "mjs", "application/javascript" }, { "json", "application/json" },
+  { "map", "application/json" }, { "wasm", "application/wasm" }, { "pdf", "application/pdf" },
+  { "png", "image/png" }, { "jpg", "image/jpeg" }, { "jpeg", "image/jpeg" }, { "gif", "image/gif" },
+  { "webp", "image/webp" }, { "avif", "image/avif" }, { "svg", "image/svg+xml" }, { "ico", "image/x-icon" },
+  { "woff", "font/woff" }, { "woff2", "font/woff2" }, { "ttf", "font/ttf" }, { "otf", "font/otf" },
+  { "mp3", "audio/mpeg" }, { "ogg", "audio/ogg" }, { "wav", "audio/wav" },
+  { "mp4", "video/mp4" }, { "webm", "video/webm" },
+};
+
+const char *mime_type_for(std::string_view path) {
+  size_t dot = path.rfind('.');
+  size_t slash = path.rfind('/');
+  if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash))
+    return "application/octet-stream";
+
+  std::string_view extension = path.substr(dot + 1);
+  for (const auto &entry : mime_types) {
+    if (extension.length() == strlen(entry.extension) && strncasecmp(extension.data(), entry.extension, extension.length()) == 0)
+      return entry.type;
+  }
+
+  return "application/octet-stream";
+}
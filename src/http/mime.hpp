@@ -0,0 +1,9 @@
+#ifndef __HTTP_MIME_HPP__
+#define __HTTP_MIME_HPP__
+
+#include <string_view>
+
+// MIME type for a file from its extension (case-insensitive), application/octet-stream if unknown
+const char *mime_type_for(std::string_view path);
+
+#endif
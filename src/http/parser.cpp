@@ -0,0 +1,237 @@
+#include "parser.hpp"
+
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <strings.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+// RFC 9110 tchar, the characters allowed in methods and header names
+static const std::array<bool, 256> token_chars = [] {
+  std::array<bool, 256> table{};
+  for (int c = '0'; c <= '9'; ++c) table[c] = true;
+  for (int c = 'A'; c <= 'Z'; ++c) table[c] = true;
+  for (int c = 'a'; c <= 'z'; ++c) table[c] = true;
+  for (const char *c = "!#$%&'*+-.^_`|~"; *c; ++c) table[static_cast<unsigned char>(*c)] = true;
+  return table;
+}();
+
+static bool is_token_char(unsigned char c) {
+  return token_chars[c];
+}
+
+static bool is_token(std::string_view text) {
+  if (text.empty())
+    return false;
+
+  for (char c : text) {
+    if (!is_token_char(c))
+      return false;
+  }
+  return true;
+}
+
+// Control characters other than tab may not appear in a request line or field value
+static bool has_control_char(std::string_view text) {
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i below_space = _mm_set1_epi8(0x1f), tab = _mm_set1_epi8('\t'), del = _mm_set1_epi8(0x7f);
+  for (; i + 16 <= text.size(); i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, below_space), chunk); // unsigned c <= 0x1f
+    control = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, tab), control);
+    control = _mm_or_si128(control, _mm_cmpeq_epi8(chunk, del));
+    if (_mm_movemask_epi8(control) != 0)
+      return true;
+  }
+#endif
+
+  for (; i < text.size(); ++i) {
+    unsigned char c = text[i];
+    if ((c < 0x20 && c != '\t') || c == 0x7f)
+      return true;
+  }
+  return false;
+}
+
+std::string_view trim_whitespace(std::string_view text) {
+  size_t first = text.find_first_not_of(" \t");
+  if (first == std::string_view::npos)
+    return {};
+
+  size_t last = text.find_last_not_of(" \t");
+  return text.substr(first, last - first + 1);
+}
+
+// Index of the first c in data at or after from, compares 16 bytes at a time with SSE2
+size_t find_byte(std::string_view data, char c, size_t from) {
+  if (from >= data.size())
+    return std::string_view::npos;
+
+  const char *start = data.data() + from;
+  size_t remaining = data.size() - from;
+
+#ifdef __SSE2__
+  const __m128i needle = _mm_set1_epi8(c);
+  size_t i = 0;
+  for (; i + 16 <= remaining; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(start + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (mask != 0)
+      return from + i + __builtin_ctz(mask);
+  }
+
+  for (; i < remaining; ++i) {
+    if (start[i] == c)
+      return from + i;
+  }
+  return std::string_view::npos;
+#else
+  const void *hit = memchr(start, c, remaining);
+  return hit ? static_cast<const char *>(hit) - data.data() : std::string_view::npos;
+#endif
+}
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+  return a.length() == b.length() && strncasecmp(a.data(), b.data(), a.length()) == 0;
+}
+
+
+std::string_view http_request::header_value(std::string_view name) const {
+  for (const header &field : this->headers) {
+    if (equals_ignore_case(field.name, name))
+      return field.value;
+  }
+  return {};
+}
+
+bool http_request::has_header(std::string_view name) const {
+  for (const header &field : this->headers) {
+    if (equals_ignore_case(field.name, name))
+      return true;
+  }
+  return false;
+}
+
+
+http_parser::http_parser(size_t max_head_size, size_t max_header_count)
+  : max_head_size(max_head_size), max_header_count(max_header_count) {}
+
+void http_parser::reset() {
+  this->scanned = 0;
+  this->length = 0;
+  this->error = 0;
+}
+
+http_parser::status http_parser::fail(int code) {
+  this->error = code;
+  return status::error;
+}
+
+// Offset just past the blank line ending the head, npos if it has not arrived. Bare LF line
+// endings are accepted as well as CRLF.
+size_t http_parser::find_head_end(std::string_view data) {
+  size_t pos = this->scanned;
+
+  for (;;) {
+    size_t newline = find_byte(data, '\n', pos);
+    if (newline == std::string_view::npos)
+      break;
+
+    if ((newline >= 1 && data[newline - 1] == '\n') ||
+        (newline >= 2 && data[newline - 1] == '\r' && data[newline - 2] == '\n'))
+      return newline + 1;
+
+    pos = newline + 1;
+  }
+
+  this->scanned = data.size(); // the look-behind above never needs bytes before this
+  return std::string_view::npos;
+}
+
+// method SP request-target SP HTTP-version
+bool http_parser::parse_request_line(std::string_view line, http_request &request) {
+  size_t first_space = find_byte(line, ' ');
+  size_t second_space = find_byte(line, ' ', first_space + 1);
+  if (first_space == std::string_view::npos || second_space == std::string_view::npos)
+    return false;
+
+  request.method = line.substr(0, first_space);
+  request.target = line.substr(first_space + 1, second_space - first_space - 1);
+  request.version = line.substr(second_space + 1);
+
+  if (!is_token(request.method) || request.target.empty() || has_control_char(request.target) ||
+      find_byte(request.target, '\t') != std::string_view::npos)
+    return false;
+
+  return request.version.length() == 8 && request.version.compare(0, 5, "HTTP/") == 0 &&
+         isdigit(request.version[5]) && request.version[6] == '.' && isdigit(request.version[7]);
+}
+
+// field-name ":" OWS field-value OWS
+bool http_parser::parse_header_line(std::string_view line, http_request &request) {
+  size_t colon = find_byte(line, ':');
+  if (colon == std::string_view::npos)
+    return false;
+
+  std::string_view name = line.substr(0, colon);
+  std::string_view value = line.substr(colon + 1);
+  if (!is_token(name) || has_control_char(value)) // also rejects space before the colon and obs-fold
+    return false;
+
+  request.headers.push_back({ name, trim_whitespace(value) });
+  return true;
+}
+
+// Parse the head at the start of data, views in request point into data
+http_parser::status http_parser::parse(std::string_view data, http_request &request) {
+  // a client may send empty lines before the request line, skip them
+  size_t start = 0;
+  while (start < data.size() && (data[start] == '\r' || data[start] == '\n'))
+    ++start;
+  if (this->scanned < start)
+    this->scanned = start;
+
+  size_t end = this->find_head_end(data);
+  if (end == std::string_view::npos)
+    return data.size() > this->max_head_size ? this->fail(431) : status::incomplete;
+  if (end > this->max_head_size)
+    return this->fail(431);
+
+  request.headers.clear();
+  this->length = end;
+
+  size_t line_start = start;
+  bool first_line = true;
+  for (;;) {
+    size_t newline = find_byte(data, '\n', line_start);
+    std::string_view line = data.substr(line_start, newline - line_start);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+
+    if (line.empty())
+      break; // the blank line ending the head
+
+    if (first_line) {
+      if (!this->parse_request_line(line, request))
+        return this->fail(400);
+      if (request.version[5] != '1')
+        return this->fail(505); // well formed, but not HTTP/1.x
+      first_line = false;
+    } else {
+      if (request.headers.size() >= this->max_header_count)
+        return this->fail(431);
+      if (!this->parse_header_line(line, request))
+        return this->fail(400);
+    }
+
+    line_start = newline + 1;
+  }
+
+  return status::complete;
+}
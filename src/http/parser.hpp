@@ -0,0 +1,52 @@
+#ifndef __HTTP_PARSER_HPP__
+#define __HTTP_PARSER_HPP__
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// One parsed request head. Every view points into the buffer that was parsed and stays valid
+// until that buffer is modified, nothing is copied.
+struct http_request {
+  struct header {
+    std::string_view name, value;
+  };
+
+  std::string_view method, target, version;
+  std::vector<header> headers; // in arrival order, values trimmed of surrounding whitespace
+
+  std::string_view header_value(std::string_view name) const; // first match, case-insensitive, empty if absent
+  bool has_header(std::string_view name) const;
+};
+
+// Incremental HTTP/1.x request head parser. Call parse() whenever more bytes arrive with the
+// buffer starting at the head; the search for the blank line resumes where the last call stopped.
+class http_parser {
+  public:
+    enum class status { incomplete, complete, error };
+
+    http_parser(size_t max_head_size = 8192, size_t max_header_count = 100);
+
+    status parse(std::string_view data, http_request &request);
+    size_t head_length() const { return length; } // bytes of the complete head, including the blank line
+    int error_code() const { return error; } // status to answer an error with: 400, 431 or 505
+    void reset(); // start on the next head, after head_length() bytes were consumed
+  private:
+    size_t find_head_end(std::string_view data);
+    bool parse_request_line(std::string_view line, http_request &request);
+    bool parse_header_line(std::string_view line, http_request &request);
+    status fail(int code);
+
+    size_t max_head_size, max_header_count;
+    size_t scanned = 0; // bytes already searched for the end of the head
+    size_t length = 0;
+    int error = 0;
+};
+
+// Index of the first c in data at or after from, npos if there is none. Uses SSE2 when available.
+size_t find_byte(std::string_view data, char c, size_t from = 0);
+
+bool equals_ignore_case(std::string_view a, std::string_view b);
+std::string_view trim_whitespace(std::string_view text); // strip surrounding spaces and tabs
+
+#endif
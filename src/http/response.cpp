@@ -0,0 +1,33 @@
+#include "response.hpp"
+
+
+// Add response code to response
+void add_response_code(std::string &response, const int code, const std::string msg) {
+  response += "HTTP/1.1 ";
+  response += std::to_string(code);
+  response += " " + msg + "\r\n";
+}
+
+// Add header to response
+void add_header(std::string &response, const std::string header_key, const std::string &header_val) {
+  response += header_key + ": " + header_val + "\r\n";
+}
+
+// Add the connection and framing headers followed by the body to a response
+void add_body(std::string &response, const std::string &body, bool keep_alive) {
+  add_header(response, "Connection", keep_alive ? "keep-alive" : "close");
+  add_header(response, "Content-Length", std::to_string(body.length()));
+  response += "\r\n";
+  response += body;
+}
+
+void add_cached_response(output_queue &response, std::string_view header, std::string_view body, bool keep_alive, const asset *source) {
+  response.append(header);
+  response.append(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+
+  if (source && source->get_fd() >= 0) {
+    response.append_file(body, source->get_fd(), body.data() - source->data().data());
+  } else {
+    response.append_ref(body);
+  }
+}
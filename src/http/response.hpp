@@ -0,0 +1,20 @@
+#ifndef __HTTP_RESPONSE_HPP__
+#define __HTTP_RESPONSE_HPP__
+
+#include <string>
+#include <string_view>
+
+#include "util/output_queue.hpp"
+#include "util/asset.hpp"
+
+// Pieces of an HTTP/1.1 response. Generated responses (errors, /metrics, the 503 for shed
+// connections) are built up as text, cached files are a pre-serialized head plus a referenced body.
+void add_response_code(std::string &response, const int code, const std::string msg);
+void add_header(std::string &response, const std::string header_key, const std::string &header_val);
+void add_body(std::string &response, const std::string &body, bool keep_alive); // framing headers, blank line and body
+
+// Queue a cached response, the body is referenced rather than copied. Bodies of mapped files also
+// remember their file so a kernel TLS connection can send them with sendfile.
+void add_cached_response(output_queue &response, std::string_view header, std::string_view body, bool keep_alive, const asset *source = nullptr);
+
+#endif
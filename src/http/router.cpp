@@ -0,0 +1,135 @@
+#include "router.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+#define KEYS_PER_BUCKET 4 // average, smaller buckets find a pilot sooner but need more pilots
+#define MAX_PILOT_TRIES (1u << 20) // per bucket before starting over with another seed
+
+
+// splitmix64 finaliser
+static uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Hash of a path, eight bytes at a time
+static uint64_t hash_path(std::string_view path, uint64_t seed) {
+  uint64_t hash = seed ^ (path.length() * 0x9e3779b97f4a7c15ULL);
+  size_t i = 0;
+
+  for (; i + 8 <= path.length(); i += 8) {
+    uint64_t word;
+    memcpy(&word, path.data() + i, sizeof(word));
+    hash = mix(hash ^ word);
+  }
+
+  if (i < path.length()) {
+    uint64_t word = 0;
+    memcpy(&word, path.data() + i, path.length() - i);
+    hash = mix(hash ^ word);
+  }
+
+  return mix(hash);
+}
+
+// Slot for a key of a bucket with this pilot, mixed again so keys sharing low hash bits still part
+size_t route_table::slot_of(uint64_t hash, uint64_t pilot) const {
+  return mix(hash ^ pilot) & (this->slots.size() - 1);
+}
+
+route_table::route_table(std::vector<std::pair<std::string, uint32_t>> routes) {
+  // duplicates keep their first value
+  std::stable_sort(routes.begin(), routes.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+  routes.erase(std::unique(routes.begin(), routes.end(), [](const auto &a, const auto &b) { return a.first == b.first; }), routes.end());
+  this->route_count = routes.size();
+  if (routes.empty())
+    return;
+
+  std::vector<uint32_t> offsets;
+  offsets.reserve(routes.size());
+  for (const auto &[path, value] : routes) {
+    offsets.push_back(this->keys.length());
+    this->keys += path;
+  }
+
+  // a seed only fails when two paths share a full 64 bit hash, the next one will not
+  while (!this->build(routes, offsets)) {
+    this->seed = mix(this->seed + 1);
+  }
+}
+
+// Place every route with the current seed, false if some bucket found no pilot
+bool route_table::build(const std::vector<std::pair<std::string, uint32_t>> &routes, const std::vector<uint32_t> &offsets) {
+  size_t count = routes.size();
+  size_t slot_count = 1;
+  while (slot_count < count + count / 4) // at most 80% full
+    slot_count <<= 1;
+
+  this->slots.assign(slot_count, slot());
+  this->pilots.assign((count + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET, 0);
+
+  std::vector<uint64_t> hashes(count);
+  std::vector<std::vector<uint32_t>> buckets(this->pilots.size());
+  for (size_t i = 0; i < count; ++i) {
+    hashes[i] = hash_path(routes[i].first, this->seed);
+    buckets[this->bucket_of(hashes[i])].push_back(i);
+  }
+
+  // the largest buckets are hardest to place, give them the emptiest table
+  std::vector<uint32_t> order(buckets.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+  std::vector<size_t> targets;
+  for (uint32_t bucket : order) {
+    if (buckets[bucket].empty())
+      break;
+
+    uint64_t pilot = 0;
+    for (uint32_t tries = 0; ; ++tries, pilot = mix(tries)) {
+      if (tries == MAX_PILOT_TRIES)
+        return false;
+
+      // every key of the bucket needs a free slot, and not the same one as another key
+      targets.clear();
+      bool placed = true;
+      for (uint32_t key : buckets[bucket]) {
+        size_t target = this->slot_of(hashes[key], pilot);
+        if (this->slots[target].value != npos || std::find(targets.begin(), targets.end(), target) != targets.end()) {
+          placed = false;
+          break;
+        }
+        targets.push_back(target);
+      }
+
+      if (placed)
+        break;
+    }
+
+    this->pilots[bucket] = pilot;
+    for (size_t i = 0; i < targets.size(); ++i) {
+      uint32_t key = buckets[bucket][i];
+      this->slots[targets[i]] = { hashes[key], offsets[key], static_cast<uint32_t>(routes[key].first.length()), routes[key].second };
+    }
+  }
+
+  return true;
+}
+
+uint32_t route_table::find(std::string_view path) const {
+  if (this->slots.empty())
+    return npos;
+
+  uint64_t hash = hash_path(path, this->seed);
+  const slot &candidate = this->slots[this->slot_of(hash, this->pilots[this->bucket_of(hash)])];
+
+  // an unlisted path still lands on some slot, the stored key decides
+  if (candidate.hash != hash || candidate.key_length != path.length() ||
+      memcmp(this->keys.data() + candidate.key_offset, path.data(), path.length()) != 0)
+    return npos;
+
+  return candidate.value;
+}
@@ -0,0 +1,42 @@
+#ifndef __HTTP_ROUTER_HPP__
+#define __HTTP_ROUTER_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Maps request paths to values, built once and then only read. The table is a perfect hash
+// (hash and displace): keys are split into small buckets and every bucket gets a pilot value
+// that sends its keys to slots no other key uses. A lookup hashes the path once, reads one pilot
+// and one slot and compares a single key, it never probes further and never allocates.
+class route_table {
+  public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    route_table() = default;
+    // When a path is listed more than once the first value wins
+    explicit route_table(std::vector<std::pair<std::string, uint32_t>> routes);
+
+    uint32_t find(std::string_view path) const; // npos if the path is not routed
+    size_t size() const { return route_count; }
+  private:
+    struct slot {
+      uint64_t hash = 0;
+      uint32_t key_offset = 0, key_length = 0; // the path, a slice of keys
+      uint32_t value = npos;
+    };
+
+    bool build(const std::vector<std::pair<std::string, uint32_t>> &routes, const std::vector<uint32_t> &offsets);
+    size_t bucket_of(uint64_t hash) const { return ((hash >> 32) * pilots.size()) >> 32; }
+    size_t slot_of(uint64_t hash, uint64_t pilot) const;
+
+    std::string keys; // every path back to back
+    std::vector<uint64_t> pilots; // one per bucket
+    std::vector<slot> slots; // a power of two, some left empty
+    uint64_t seed = 0;
+    size_t route_count = 0;
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "reactor.hpp"
+
+#include <stdexcept>
+#include <iterator>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <openssl/err.h>
+
+#include "server.hpp"
+#include "util/log.hpp"
+
+#define MAX_EVENTS 256
+#define READ_CHUNK 16384
+
+
+// Creates the epoll instance and starts the event loop thread, pinned to the given core
+reactor::reactor(const https_server *server, int core) : server(server) {
+  this->read_timeouts();
+
+  this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->epoll_fd < 0 || this->wake_fd < 0) {
+    throw std::runtime_error(std::string("Unable to create reactor: ") + strerror(errno));
+  }
+
+  // the wake up descriptor is the only event without a connection attached
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &ev);
+
+  this->thread = std::thread(&reactor::event_loop, this);
+  pin_thread(this->thread, core);
+
+  log_info("REACTOR: Event loop %d started", core);
+}
+
+// Stop the event loop and close every connection still open
+reactor::~reactor() {
+  this->should_terminate = true;
+
+  uint64_t one = 1;
+  if (write(this->wake_fd, &one, sizeof(one)) < 0) {
+    log_info("REACTOR: ERROR: Unable to wake event loop: %s", strerror(errno));
+  }
+  this->thread.join();
+
+  while (!this->connections.empty()) {
+    this->close_connection(this->connections.front());
+  }
+
+  close(this->wake_fd);
+  close(this->epoll_fd);
+}
+
+// Queue a connection for the reactor thread and wake it up to adopt it
+void reactor::add_connection(const job_t::info_t &info) {
+  { // after the mutex goes out of scope it is released
+    std::lock_guard<std::mutex> lock(this->pending_mutex);
+    this->pending.push_back(info);
+  }
+
+  uint64_t one = 1;
+  if (write(this->wake_fd, &one, sizeof(one)) < 0) {
+    log_info("REACTOR: ERROR: Unable to wake event loop: %s", strerror(errno));
+  }
+}
+
+// Main function of the reactor thread, dispatches readiness events to their connections
+void reactor::event_loop(void) {
+  struct epoll_event events[MAX_EVENTS];
+  clock::time_point last_sweep = clock::now();
+
+  while (!this->should_terminate) {
+    int n = epoll_wait(this->epoll_fd, events, MAX_EVENTS, 1000);
+    if (n < 0 && errno != EINTR) {
+      log_info("REACTOR: ERROR: epoll_wait failed: %s", strerror(errno));
+      return;
+    }
+
+    for (int i = 0; i < n; ++i) {
+      if (events[i].data.ptr == nullptr) {
+        uint64_t count;
+        while (read(this->wake_fd, &count, sizeof(count)) > 0); // drain wake ups
+        this->adopt_pending();
+      } else {
+        this->drive(*static_cast<connection *>(events[i].data.ptr));
+      }
+    }
+
+    // deadlines only need second resolution, sweep once a second at most
+    clock::time_point now = clock::now();
+    if (now - last_sweep >= std::chrono::seconds(1)) {
+      this->read_timeouts(); // picks up a reload
+      this->close_expired(now);
+      last_sweep = now;
+    }
+  }
+}
+
+// Take ownership of every connection queued by the accept thread and register it with epoll
+void reactor::adopt_pending(void) {
+  std::vector<job_t::info_t> adopted;
+  { // after the mutex goes out of scope it is released
+    std::lock_guard<std::mutex> lock(this->pending_mutex);
+    adopted.swap(this->pending);
+  }
+
+  for (const auto &info : adopted) {
+    connection &conn = this->connections.emplace_back();
+    conn.info = info;
+    conn.parser = this->server->new_parser();
+    conn.self = std::prev(this->connections.end());
+    conn.adopted = clock::now();
+    conn.deadline = conn.adopted + this->client_timeout;
+    this->connection_count++;
+    this->server->metrics.observe(server_metrics::timer::queue_wait, conn.adopted - info.queued_at);
+
+    // writes are resumed from wherever the last partial write stopped
+    SSL_set_mode(info.ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = &conn;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, info.client_fd, &ev) < 0) {
+      log_info("REACTOR: ERROR: Unable to watch client %s: %s", inet_ntoa(info.client_addr.sin_addr), strerror(errno));
+      this->close_connection(conn);
+      continue;
+    }
+
+    this->drive(conn); // the client hello may already be waiting
+  }
+}
+
+// Advance a connection as far as it can go without blocking. Edge-triggered readiness means every
+// call must run until OpenSSL reports SSL_ERROR_WANT_READ/WRITE, the next edge resumes from there.
+void reactor::drive(connection &conn) {
+  SSL *ssl = conn.info.ssl;
+  char recv_buf[READ_CHUNK];
+
+  for (;;) {
+    int ret = 0;
+
+    switch (conn.current) {
+      case connection::state::handshake:
+        ret = SSL_accept(ssl);
+        if (ret == 1) {
+          this->server->count_handshake(ssl, conn.adopted);
+          conn.ktls = BIO_get_ktls_send(SSL_get_wbio(ssl));
+          if (conn.ktls)
+            this->server->ktls_connections++;
+          conn.http2 = this->server->new_http2_session(ssl);
+
+          conn.current = connection::state::reading;
+          conn.deadline = clock::now() + this->client_timeout;
+          continue;
+        }
+        break;
+
+      case connection::state::reading:
+        ret = SSL_read(ssl, recv_buf, sizeof(recv_buf));
+        if (ret > 0) {
+          conn.request.append(recv_buf, ret);
+          conn.keep_alive = this->serve(conn);
+
+          if (!conn.response.empty()) {
+            conn.current = connection::state::writing;
+            conn.deadline = clock::now() + this->client_timeout;
+          } else if (!conn.keep_alive) {
+            this->close_connection(conn);
+            return;
+          }
+          continue;
+        }
+        break;
+
+      case connection::state::writing:
+        ret = conn.response.write_to(ssl, conn.ktls);
+        if (ret <= 0 && conn.response.truncated()) {
+          this->close_connection(conn); // a file shrank under its response, the rest cannot be sent
+          return;
+        }
+        if (ret > 0) {
+          conn.deadline = clock::now() + this->client_timeout; // progress resets the clock
+
+          if (!conn.response.empty())
+            continue;
+
+          if (!conn.keep_alive) {
+            this->close_connection(conn);
+            return;
+          }
+
+          // answer anything pipelined behind the request just served, or send more HTTP/2 bodies, before reading again
+          conn.keep_alive = this->serve(conn);
+          if (conn.response.empty()) {
+            conn.current = connection::state::reading;
+            conn.deadline = clock::now() + (conn.request.empty() ? this->idle_timeout : this->client_timeout);
+          }
+          continue;
+        }
+        break;
+    }
+
+    int ssl_error = SSL_get_error(ssl, ret);
+    if (ssl_error == SSL_ERROR_WANT_READ || ssl_error == SSL_ERROR_WANT_WRITE)
+      return; // wait for the next readiness edge
+
+    if (conn.current == connection::state::handshake) {
+      char err_buf[256];
+      ERR_error_string_n(ERR_get_error(), err_buf, sizeof(err_buf));
+      log_info("SERVER: SSL handshake failed for client %s - SSL_error: %d, Error: %s",
+               inet_ntoa(conn.info.client_addr.sin_addr), ssl_error, err_buf);
+    } else if (conn.served == 0) {
+      log_info("SERVER: INCOMING CONNECTION: %12s - Empty or malformed request received. dropping connection.", inet_ntoa(conn.info.client_addr.sin_addr));
+    }
+
+    ERR_clear_error();
+    this->close_connection(conn);
+    return;
+  }
+}
+
+// Answer what has been read so far with whichever protocol the connection speaks
+bool reactor::serve(connection &conn) {
+  if (conn.http2)
+    return this->server->serve_http2(conn.request, *conn.http2, conn.response, conn.site, conn.served, conn.info.client_addr.sin_addr);
+
+  return this->server->serve_requests(conn.request, conn.parser, conn.response, conn.site, conn.served, conn.info.client_addr.sin_addr);
+}
+
+// Tear down the TLS session and socket, closing the descriptor also removes it from epoll
+void reactor::close_connection(connection &conn) {
+  if (conn.current != connection::state::handshake) {
+    SSL_shutdown(conn.info.ssl); // send close_notify, never wait for the peer's
+  }
+
+  SSL_free(conn.info.ssl);
+  close(conn.info.client_fd);
+
+  this->connection_count--;
+  this->connections.erase(conn.self);
+}
+
+// Take the timeouts from the current config
+void reactor::read_timeouts(void) {
+  const server_config &config = this->server->get_config();
+  this->client_timeout = config.client_timeout;
+  this->idle_timeout = config.keep_alive_timeout;
+}
+
+// Close connections that missed their handshake, read, write or keep-alive deadline
+void reactor::close_expired(clock::time_point now) {
+  for (auto it = this->connections.begin(); it != this->connections.end(); ) {
+    connection &conn = *it++;
+    if (now > conn.deadline) {
+      this->close_connection(conn);
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef __REACTOR_HPP__
+#define __REACTOR_HPP__
+
+#include <string>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include <openssl/ssl.h>
+#include <netinet/in.h> // struct sockaddr_in
+
+#include "util/pool.hpp"
+#include "util/output_queue.hpp"
+#include "http/parser.hpp"
+#include "server.hpp"
+
+// One edge-triggered epoll event loop running on its own thread. Every connection handed to a
+// reactor lives on it until closed, driven by non-blocking OpenSSL calls, so an idle or slow
+// client costs a small state object rather than a blocked worker thread.
+class reactor {
+  public:
+    reactor(const https_server *server, int core);
+    ~reactor();
+
+    // Hand over a freshly accepted connection, safe to call from any thread
+    void add_connection(const job_t::info_t &info);
+    size_t get_connection_count() const { return connection_count.load(std::memory_order_relaxed); }
+  private:
+    using clock = std::chrono::steady_clock;
+
+    // Per connection state, owned by the reactor thread
+    struct connection {
+      enum class state { handshake, reading, writing };
+
+      job_t::info_t info;
+      state current = state::handshake;
+      std::string request;
+      http_parser parser;
+      std::unique_ptr<http2_session> http2; // set when ALPN chose h2, request then holds frames
+      output_queue response;
+      std::shared_ptr<const https_server::site> site; // what the queued responses point into
+      int served = 0;
+      bool keep_alive = true;
+      bool ktls = false; // kernel TLS took over sending, file bodies go out with sendfile
+      clock::time_point deadline;
+      clock::time_point adopted; // when the handshake started
+      std::list<connection>::iterator self;
+    };
+
+    void event_loop(void);
+    void adopt_pending(void);
+    void drive(connection &conn);
+    bool serve(connection &conn);
+    void close_connection(connection &conn);
+    void close_expired(clock::time_point now);
+    void read_timeouts(void);
+
+    const https_server *server;
+    int epoll_fd = -1, wake_fd = -1;
+    std::atomic<bool> should_terminate{false};
+
+    std::mutex pending_mutex;
+    std::vector<job_t::info_t> pending;
+
+    std::list<connection> connections;
+    std::atomic<size_t> connection_count{0};
+    std::chrono::milliseconds client_timeout, idle_timeout;
+
+    std::thread thread;
+};
+
+#endif
@@ -7,21 +7,43 @@
 #include <stdexcept>
 #include <chrono>
 #include <iomanip>
+#include <algorithm>
+#include <unordered_set>
+#include <filesystem>
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <cstring>
+#include <csignal>
+#include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <sys/inotify.h>
 #include <sys/utsname.h>
 #include <arpa/inet.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
 
 #include "util/pool.hpp"
 #include "util/log.hpp"
+#include "util/output_queue.hpp"
+#include "util/compress.hpp"
+#include "util/ip_snapshot.hpp"
+#include "util/metrics.hpp"
+#include "util/tls_session.hpp"
+#include "reactor.hpp"
+#include "http/parser.hpp"
+#include "http/mime.hpp"
+#include "http/response.hpp"
 
 #define SERVER_VERSION "1.1.1"
 #define MAX_LINE 4096
+#define SHED_TIMEOUT_MS 1000 // handshake and write budget for answering a shed connection with 503
+#define CONFIG_PATH "./secure-serve.conf"
+#define RELOAD_SETTLE_MS 200 // quiet time after the last file change before reloading
 
 // Git commit hash is defined by CMake at build time
 #ifndef GIT_COMMIT_HASH
@@ -52,42 +74,349 @@ static void ssl_shutdown_wrapper(SSL *ssl) {
   }
 }
 
-// Add response code to response
-static void add_response_code(std::string &response, const int code, const std::string msg) { 
-  response += "HTTP/1.0 ";
-  response += std::to_string(code);
-  response += " " + msg + "\n";
+// Written to by the SIGHUP handler (and on shutdown) to wake the watcher thread
+static int reload_pipe[2] = { -1, -1 };
+
+static void request_reload(int) {
+  int saved_errno = errno;
+  char signal_byte = 'r';
+  if (write(reload_pipe[1], &signal_byte, 1) < 0) {} // pipe full means a reload is already pending
+  errno = saved_errno;
+}
+
+// Directory part of a path, "." for a bare file name
+static std::string parent_directory(const std::string &path) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos)
+    return ".";
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// Last component of a path
+static std::string file_name(const std::string &path) {
+  return path.substr(path.rfind('/') + 1);
+}
+
+// Put a client socket into non-blocking mode so no SSL call can stall a thread indefinitely
+static bool set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+// Milliseconds left until a deadline, clamped to zero
+static int remaining_ms(std::chrono::steady_clock::time_point deadline) {
+  auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+  return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+}
+
+// Called after a non-blocking SSL call returned ret <= 0. Waits until the socket is ready for
+// whatever OpenSSL asked for. Returns false if the call failed for good or the wait timed out.
+static bool ssl_wait(SSL *ssl, int fd, int ret, int timeout_ms) {
+  struct pollfd pfd = { fd, 0, 0 };
+
+  switch (SSL_get_error(ssl, ret)) {
+    case SSL_ERROR_WANT_READ:  pfd.events = POLLIN;  break;
+    case SSL_ERROR_WANT_WRITE: pfd.events = POLLOUT; break;
+    default: return false; // closed by peer or a protocol error
+  }
+
+  int n;
+  do {
+    n = poll(&pfd, 1, timeout_ms);
+  } while (n < 0 && errno == EINTR);
+
+  return n > 0;
+}
+
+// Decide whether a connection may stay open after answering this request.
+// HTTP/1.1 is persistent unless the client says otherwise, HTTP/1.0 must ask for it.
+static bool wants_keep_alive(const http_request &request) {
+  std::string_view connection = request.header_value("Connection");
+
+  // requests carrying a body are not framed by this server, close after answering
+  std::string_view content_length = request.header_value("Content-Length");
+  if (request.has_header("Transfer-Encoding") || (!content_length.empty() && content_length.find_first_not_of('0') != std::string_view::npos))
+    return false;
+
+  if (request.version.compare("HTTP/1.1") == 0)
+    return !equals_ignore_case(connection, "close");
+
+  return equals_ignore_case(connection, "keep-alive");
+}
+
+// Pre-serialize the status line and headers of a cached response, only the Connection
+// header and the blank line are left for the request path to add. variant selects a
+// precompressed copy, nullptr the identity encoding.
+static std::string build_cached_header(const int code, const std::string msg, const https_server::file_info &file,
+                                       const https_server::file_info::variant *variant = nullptr) {
+  std::string header;
+  add_response_code(header, code, msg);
+  add_header(header, "Content-Type", file.MIME_type);
+  add_header(header, "Content-Length", std::to_string(variant ? variant->contents.length() : file.contents.length()));
+
+  if (variant)
+    add_header(header, "Content-Encoding", variant->encoding);
+
+  // validators only make sense on the real representation, not on error pages
+  if (code == 200) {
+    add_header(header, "ETag", variant ? variant->etag : file.etag);
+    add_header(header, "Last-Modified", file.last_modified_str);
+    add_header(header, "Accept-Ranges", "bytes");
+  }
+
+  if (!file.variants.empty())
+    add_header(header, "Vary", "Accept-Encoding");
+
+  return header;
+}
+
+// Pre-serialize the body-less 304 answer to a conditional request
+static std::string build_not_modified_header(const https_server::file_info &file, const https_server::file_info::variant *variant = nullptr) {
+  std::string header;
+  add_response_code(header, 304, "NOT MODIFIED");
+  add_header(header, "ETag", variant ? variant->etag : file.etag);
+  add_header(header, "Last-Modified", file.last_modified_str);
+
+  if (!file.variants.empty())
+    add_header(header, "Vary", "Accept-Encoding");
+
+  return header;
+}
+
+// Quoted entity tag from the first 8 bytes of a digest
+static std::string format_etag(const unsigned char *digest, const std::string &encoding) {
+  char hex[17];
+  for (int i = 0; i < 8; ++i) {
+    snprintf(hex + i * 2, 3, "%02x", digest[i]);
+  }
+
+  return "\"" + std::string(hex) + (encoding.empty() ? "" : "-" + encoding) + "\"";
+}
+
+// Strong entity tag for a body, a truncated SHA-256 of the bytes served
+static std::string make_etag(std::string_view contents, const std::string &encoding = "") {
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_length = 0;
+  EVP_Digest(contents.data(), contents.length(), digest, &digest_length, EVP_sha256(), nullptr);
+  return format_etag(digest, encoding);
+}
+
+// The same for a mapped file, hashed a chunk at a time through asset::copy_mapped() so a file
+// truncated while it loads fails the load instead of faulting. Empty if that happened.
+static std::string make_mapped_etag(std::string_view mapped) {
+  std::string chunk(output_queue::max_chunk, '\0');
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_length = 0;
+  bool complete = true;
+
+  EVP_MD_CTX *context = EVP_MD_CTX_new();
+  EVP_DigestInit_ex(context, EVP_sha256(), nullptr);
+  for (size_t offset = 0; complete && offset < mapped.length(); offset += chunk.length()) {
+    size_t length = std::min(chunk.length(), mapped.length() - offset);
+    complete = asset::copy_mapped(chunk.data(), mapped.data() + offset, length);
+    EVP_DigestUpdate(context, chunk.data(), complete ? length : 0);
+  }
+  EVP_DigestFinal_ex(context, digest, &digest_length);
+  EVP_MD_CTX_free(context);
+
+  return complete ? format_etag(digest, "") : "";
+}
+
+// Format a timestamp as an HTTP date (e.g., "Sun, 06 Nov 1994 08:49:37 GMT")
+static std::string format_http_date(time_t timestamp) {
+  char buffer[32];
+  struct tm tm_utc;
+  std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&timestamp, &tm_utc));
+  return std::string(buffer);
+}
+
+// Parse an HTTP date, returns -1 if it is not in the preferred IMF-fixdate format
+static time_t parse_http_date(const std::string &date) {
+  struct tm tm_utc = {};
+  const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm_utc);
+  if (end == nullptr)
+    return -1;
+
+  return timegm(&tm_utc);
 }
 
-// Add header to response
-static void add_header(std::string &response, const std::string header_key, const std::string &header_val) { 
-  response += header_key + ": " + header_val;
+// Whether an If-None-Match list names this entity tag, using the weak comparison RFC 9110 asks for
+static bool etag_matches(std::string_view if_none_match, std::string_view etag) {
+  size_t start = 0;
+
+  while (start < if_none_match.length()) {
+    size_t end = if_none_match.find(',', start);
+    if (end == std::string_view::npos)
+      end = if_none_match.length();
+
+    std::string_view tag = trim_whitespace(if_none_match.substr(start, end - start));
+    if (tag.compare(0, 2, "W/") == 0)
+      tag.remove_prefix(2);
+
+    if (tag.compare("*") == 0 || tag.compare(etag) == 0)
+      return true;
+
+    start = end + 1;
+  }
+
+  return false;
 }
 
-// Add the body to an request
-static void add_body(std::string &response, const std::string &body) { 
-  response += "\r\n\r\n" + body;
+// Quality a client gave an encoding in its Accept-Encoding header, 0 means not acceptable
+static float encoding_quality(std::string_view accept_encoding, std::string_view encoding) {
+  float wildcard = 0.0f;
+  size_t start = 0;
+
+  while (start < accept_encoding.length()) {
+    size_t end = accept_encoding.find(',', start);
+    if (end == std::string_view::npos)
+      end = accept_encoding.length();
+
+    // item is "name" or "name;q=0.5"
+    std::string_view item = accept_encoding.substr(start, end - start);
+    size_t params = item.find(';');
+    std::string_view name = trim_whitespace(item.substr(0, params));
+
+    float quality = 1.0f;
+    if (params != std::string_view::npos) {
+      size_t q = item.find("q=", params);
+      if (q != std::string_view::npos)
+        quality = atof(std::string(item.substr(q + 2)).c_str());
+    }
+
+    if (equals_ignore_case(name, encoding))
+      return quality;
+    if (name.compare("*") == 0)
+      wildcard = quality;
+
+    start = end + 1;
+  }
+
+  return wildcard;
 }
 
-// Get info related to a request
-static void get_req_info(const std::string &req, std::string &method, std::string &path) {
-  const char *data = req.data();
-  bool found_method = false;
+// Parse a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range against a body of
+// length bytes. Returns false when the header is malformed or lists several ranges, the whole body
+// is served then. satisfiable is cleared when the range lies entirely outside the body.
+static bool parse_range(const std::string &range, size_t length, size_t &first, size_t &last, bool &satisfiable) {
+  if (range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos)
+    return false;
+
+  size_t dash = range.find('-', 6);
+  if (dash == std::string::npos)
+    return false;
+
+  std::string first_str = range.substr(6, dash - 6), last_str = range.substr(dash + 1);
+  if (first_str.find_first_not_of("0123456789") != std::string::npos ||
+      last_str.find_first_not_of("0123456789") != std::string::npos ||
+      (first_str.empty() && last_str.empty())) {
+    return false;
+  }
+
+  satisfiable = true;
+  if (first_str.empty()) { // suffix range, the last N bytes
+    size_t suffix = strtoull(last_str.c_str(), nullptr, 10);
+    if (suffix == 0 || length == 0) {
+      satisfiable = false;
+      return true;
+    }
+    first = suffix >= length ? 0 : length - suffix;
+    last = length - 1;
+    return true;
+  }
+
+  first = strtoull(first_str.c_str(), nullptr, 10);
+  last = last_str.empty() ? length - 1 : std::min<size_t>(strtoull(last_str.c_str(), nullptr, 10), length - 1);
+  if (first >= length) {
+    satisfiable = false;
+    return true;
+  }
 
-  /* loop through the request */
-  for (size_t i = 0; i < strlen(data); ++i) {
-    if (!found_method) {
-      if (!isspace(data[i]))
-        method += data[i];
-      else
-        found_method = true;
+  return first <= last;
+}
+
+// An If-Range validator must match exactly for the range to apply, otherwise the whole body is sent
+static bool if_range_matches(const http_request &request, const https_server::file_info &file) {
+  std::string_view if_range = request.header_value("If-Range");
+  return if_range.empty() || if_range.compare(file.etag) == 0 || if_range.compare(file.last_modified_str) == 0;
+}
+
+// Queue a 206 answer for a byte range of the identity body, or a 416 when it cannot be satisfied.
+// Returns 0 if the request carries no usable range and the full response should be sent instead.
+static int add_range_response(output_queue &response, const https_server::file_info &file, const http_request &request, bool keep_alive) {
+  std::string range(request.header_value("Range"));
+  size_t first = 0, last = 0;
+  bool satisfiable = false;
+
+  if (range.empty() || !if_range_matches(request, file) || !parse_range(range, file.contents.length(), first, last, satisfiable))
+    return 0;
+
+  std::string header;
+  if (!satisfiable) {
+    add_response_code(header, 416, "RANGE NOT SATISFIABLE");
+    add_header(header, "Content-Range", "bytes */" + std::to_string(file.contents.length()));
+    add_header(header, "Content-Length", "0");
+    add_cached_response(response, header, std::string_view(), keep_alive);
+    return 416;
+  }
+
+  add_response_code(header, 206, "PARTIAL CONTENT");
+  add_header(header, "Content-Type", file.MIME_type);
+  add_header(header, "Content-Length", std::to_string(last - first + 1));
+  add_header(header, "Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(file.contents.length()));
+  add_header(header, "ETag", file.etag);
+  add_header(header, "Last-Modified", file.last_modified_str);
+  add_cached_response(response, header, file.contents.substr(first, last - first + 1), keep_alive, file.data.get());
+
+  return 206;
+}
+
+// Queue the smallest variant of a route the client accepts, falling back to the identity encoding.
+// With conditional set, a request whose validators still match gets a body-less 304 instead and
+// Range requests get a 206 partial body. Returns the status code sent.
+static int add_negotiated_response(output_queue &response, const https_server::file_info &file, const http_request &request, bool keep_alive, bool conditional) {
+  const https_server::file_info::variant *chosen = nullptr;
+
+  if (!file.variants.empty()) {
+    std::string_view accept_encoding = request.header_value("Accept-Encoding");
+
+    for (const auto &variant : file.variants) {
+      if (encoding_quality(accept_encoding, variant.encoding) > 0.0f) {
+        chosen = &variant;
+        break;
+      }
+    }
+  }
+
+  if (conditional) {
+    // If-None-Match takes precedence, If-Modified-Since is only consulted without it
+    std::string_view if_none_match = request.header_value("If-None-Match");
+    bool not_modified;
+    if (!if_none_match.empty()) {
+      not_modified = etag_matches(if_none_match, chosen ? chosen->etag : file.etag);
     } else {
-      if (!isspace(data[i]))
-        path += data[i];
-      else
-        return; /* nothing left to extract */
+      time_t if_modified_since = parse_http_date(std::string(request.header_value("If-Modified-Since")));
+      not_modified = if_modified_since >= 0 && file.last_modified <= if_modified_since;
+    }
+
+    if (not_modified) {
+      add_cached_response(response, chosen ? chosen->not_modified_header : file.not_modified_header, std::string_view(), keep_alive);
+      return 304;
     }
+
+    // ranges are always served from the identity encoding
+    int range_status = add_range_response(response, file, request, keep_alive);
+    if (range_status != 0)
+      return range_status;
+  }
+
+  if (chosen) {
+    add_cached_response(response, chosen->header, chosen->contents, keep_alive);
+  } else {
+    add_cached_response(response, file.header, file.contents, keep_alive, file.data.get());
   }
+
+  return 200;
 }
 
 // Get OS information from /etc/os-release
@@ -115,242 +444,359 @@ static std::string format_timestamp(time_t timestamp) {
   return std::string(buffer);
 }
 
-// Format uptime in seconds to readable string (e.g., "2d 3h 15m 30s")
-static std::string format_uptime(time_t uptime_seconds) {
-  auto duration = std::chrono::seconds(uptime_seconds);
+// Format uptime in seconds to readable string (e.g., "2d 3h 15m 30s"), returns the length written
+static int format_uptime(char *out, size_t size, time_t uptime_seconds) {
+  long days = uptime_seconds / 86400, hours = uptime_seconds / 3600 % 24, minutes = uptime_seconds / 60 % 60, seconds = uptime_seconds % 60;
+  int length = 0;
 
-  auto hours = std::chrono::duration_cast<std::chrono::hours>(duration);
-  duration -= hours;
-  auto minutes = std::chrono::duration_cast<std::chrono::minutes>(duration);
-  duration -= minutes;
-  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(duration);
+  if (days > 0) length += snprintf(out + length, size - length, "%ldd ", days);
+  if (hours > 0) length += snprintf(out + length, size - length, "%ldh ", hours);
+  if (minutes > 0) length += snprintf(out + length, size - length, "%ldm ", minutes);
+  length += snprintf(out + length, size - length, "%lds", seconds);
 
-  auto days = hours.count() / 24;
-  auto remaining_hours = hours.count() % 24;
+  return length;
+}
 
-  std::string result;
-  if (days > 0) result += std::to_string(days) + "d ";
-  if (remaining_hours > 0) result += std::to_string(remaining_hours) + "h ";
-  if (minutes.count() > 0) result += std::to_string(minutes.count()) + "m ";
-  result += std::to_string(seconds.count()) + "s";
+// The /status fields that cannot change while the server runs, serialized once at startup
+static std::string serialize_static_status(const char *io_engine, size_t thread_count, size_t listener_count, time_t start_time) {
+  struct utsname sys_info;
+  uname(&sys_info);
 
-  return result;
+  std::string body = "{\n";
+  body +=            "  \"platform\": \"" + std::string(sys_info.sysname) + "\",\n";
+  body +=            "  \"os_version\": \"" + get_os_info() + "\",\n";
+  body +=            "  \"server_version\": \"" + std::string(SERVER_VERSION) + "\",\n";
+  body +=            "  \"git_commit\": \"" + std::string(GIT_COMMIT_HASH) + "\",\n";
+  body +=            "  \"last_updated\": \"" + std::string(__DATE__) + " " + std::string(__TIME__) + "\",\n";
+  body +=            "  \"start_time\": \"" + format_timestamp(start_time) + "\",\n";
+  body +=            "  \"io_engine\": \"" + std::string(io_engine) + "\",\n";
+  body +=            "  \"thread_count\": " + std::to_string(thread_count) + ",\n";
+  body +=            "  \"listener_count\": " + std::to_string(listener_count) + ",\n";
+  return body;
 }
 
-// Get number of rate limited requests from IP log table
-static int get_rate_limited_count(const https_server::ip_log_table_t &ip_log_table, int threshold) {
-  int total_count = 0;
-  for (const auto &entry : ip_log_table) {
-    int entry_req_count = entry.second.first.load();
-    total_count += entry_req_count >= threshold ? entry_req_count - threshold : 0;
-  }
+/*****************************
+ * Request handling functions
+******************************/
 
-  return total_count;
+// Format the /status fields that change into out, returns the length written
+size_t format_status_counters(const https_server *server, char *out, size_t size) {
+  char uptime[64];
+  format_uptime(uptime, sizeof(uptime), time(nullptr) - server->start_time);
+
+  // successful answers are 2xx and 3xx, valid ones also include 404, 405 and 416
+  unsigned long successful = server->metrics.responses(200, 399);
+  unsigned long valid = successful + server->metrics.responses(404, 405) + server->metrics.responses(416, 416);
+
+  int length = snprintf(out, size,
+    "  \"uptime\": \"%s\",\n"
+    "  \"config_reloads\": %lu,\n"
+    "  \"total_requests\": %lu,\n"
+    "  \"valid_requests\": %lu,\n"
+    "  \"successful_requests\": %lu,\n"
+    "  \"ktls_connections\": %lu,\n"
+    "  \"tls_handshakes\": %lu,\n"
+    "  \"tls_resumed_handshakes\": %lu,\n"
+    "  \"queue_depth\": %zu,\n"
+    "  \"shed_queue_full\": %lu,\n"
+    "  \"shed_queue_wait\": %lu,\n"
+    "  \"rate_limited_requests\": %lu,\n"
+    "  \"tracked_clients\": %zu,\n"
+    "  \"dropped_log_messages\": %lu\n"
+    "}\n",
+    uptime, server->site_generation - 1, static_cast<unsigned long>(server->metrics.connections()), valid, successful,
+    server->ktls_connections.load(), static_cast<unsigned long>(server->metrics.handshakes(false)),
+    static_cast<unsigned long>(server->metrics.handshakes(true)), server->get_queue_depth(), server->shed_queue_full.load(), server->shed_queue_wait.load(),
+    server->limiter->get_rejected_count(), server->limiter->size(), get_dropped_log_count());
+
+  return std::min<size_t>(std::max(length, 0), size - 1);
 }
 
-// Cull entries from the IP log table that are older than the threshold
-static void cull_ip_log_table(https_server::ip_log_table_t &ip_log_table, time_t current_time, time_t threshold) {
-  for (auto it = ip_log_table.begin(); it != ip_log_table.end(); ) {
-    time_t last_request_time = it->second.second.load();
-    if (current_time - last_request_time > threshold) {
-      it = ip_log_table.erase(it);
-    } else {
-      ++it;
+// Handle the /status endpoint, returning server statistics in JSON format. The fixed fields were
+// serialized at startup and the counters are formatted into a fixed buffer. With status_cache_ms
+// every thread shares one snapshot of the counters for that long, so heavy polling does not keep
+// adding up every shard. The response is counted before formatting, so a snapshot includes the
+// request that took it and every counter is as of snapshot time.
+void handle_status_endpoint(const https_server *server, output_queue &response, struct in_addr &client_addr, bool keep_alive) {
+  server->metrics.count_response(200);
+  char counters[1024];
+  size_t length;
+
+  auto ttl = server->get_config().status_cache;
+  if (ttl.count() == 0) {
+    length = format_status_counters(server, counters, sizeof(counters));
+  } else {
+    std::lock_guard<std::mutex> lock(server->status_mutex);
+    auto now = std::chrono::steady_clock::now();
+    if (server->status_counters_length == 0 || now - server->status_taken >= ttl) {
+      server->status_counters_length = format_status_counters(server, server->status_counters, sizeof(server->status_counters));
+      server->status_taken = now;
     }
+    length = server->status_counters_length;
+    memcpy(counters, server->status_counters, length);
   }
-}
 
-// Log the IP log table to a CSV file
-static void log_ip_table_csv(const https_server::ip_log_table_t &ip_log_table, const std::string &log_path) {
-  log_info("SERVER: Writing IP log table to CSV at path: %s with %zu entries", log_path.c_str(), ip_log_table.size());
+  char framing[96];
+  int framing_length = snprintf(framing, sizeof(framing), "Connection: %s\r\nContent-Length: %zu\r\n\r\n",
+                                keep_alive ? "keep-alive" : "close", server->status_fields.length() + length);
 
-  std::ofstream log_file(log_path, std::ios::out | std::ios::trunc);
-  if (!log_file.is_open()) {
-    log_info("ERROR: Unable to open IP log file at path: %s", log_path.c_str());
-    return;
-  }
+  response.append("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n");
+  response.append(std::string_view(framing, framing_length));
+  response.append(server->status_fields);
+  response.append(std::string_view(counters, length));
 
-  log_file << "IP Address,Request Count,Last Request Timestamp,Last Request Time\n";
-  for (const auto &entry : ip_log_table) {
-    time_t timestamp = entry.second.second.load();
-    char time_buffer[32];
-    std::strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&timestamp));
-
-    log_file << entry.first << ","
-             << entry.second.first.load() << ","
-             << timestamp << ","
-             << time_buffer << "\n";
-  }
+  log_info("SERVER: INCOMING CONNECTION: %12s GET /status -> 200 OK", inet_ntoa(client_addr));
+}
 
-  log_file.close();
-  log_info("SERVER: Successfully wrote IP log CSV to %s", log_path.c_str());
+// Handle the /metrics endpoint, every counter and histogram in Prometheus text format
+void handle_metrics_endpoint(const https_server *server, output_queue &response, struct in_addr &client_addr, bool keep_alive) {
+  std::string body;
+  server->metrics.render(body, "serve_");
+
+  append_metric(body, "serve_", "uptime_seconds", "gauge", "Seconds since the server started.", time(nullptr) - server->start_time);
+  append_metric(body, "serve_", "threads", "gauge", "Pool workers or reactor event loops.", server->get_thread_count());
+  append_metric(body, "serve_", "queue_depth", "gauge", "Connections waiting for a pool worker.", server->get_queue_depth());
+  append_metric(body, "serve_", "config_reloads_total", "counter", "Times the config and routes were reloaded.", server->site_generation - 1);
+  append_metric(body, "serve_", "ktls_connections_total", "counter", "Connections sending through kernel TLS.", server->ktls_connections);
+  append_metric(body, "serve_", "http2_connections_total", "counter", "Connections that negotiated HTTP/2 through ALPN.", server->http2_connections);
+  append_metric(body, "serve_", "tls_session_cache_sessions", "gauge", "Sessions in the server-side session cache.", SSL_CTX_sess_number(server->ssl_ctx.get()));
+  append_metric(body, "serve_", "tls_ticket_key_rotations_total", "counter", "Session ticket keys generated, the first at startup.",
+                server->tickets ? server->tickets->get_rotation_count() : 0);
+  append_metric(body, "serve_", "shed_queue_full_total", "counter", "Connections refused at accept because the pool queue was full.", server->shed_queue_full);
+  append_metric(body, "serve_", "shed_queue_wait_total", "counter", "Connections shed after waiting longer than max_queue_wait_ms.", server->shed_queue_wait);
+  append_metric(body, "serve_", "rate_limited_total", "counter", "Connections refused by the rate limiter.", server->limiter->get_rejected_count());
+  append_metric(body, "serve_", "tracked_clients", "gauge", "Clients in the rate limiter's IP table.", server->limiter->size());
+  append_metric(body, "serve_", "dropped_log_messages_total", "counter", "Log lines lost because the log buffer was full.", get_dropped_log_count());
+
+  std::string status;
+  add_response_code(status, 200, "OK");
+  add_header(status, "Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+  add_body(status, body, keep_alive);
+  response.append(status);
+
+  log_info("SERVER: INCOMING CONNECTION: %12s GET /metrics -> 200 OK", inet_ntoa(client_addr));
 }
 
-/*****************************
- * Request handling functions
-******************************/
+//  handles one get request, querying the router, building an adequate response. Returns the status sent,
+//  0 when the endpoint already counted its response.
+static int handle_get_request(const https_server *server, const https_server::site &site, output_queue &response, const http_request &request,
+                               std::string_view path, struct in_addr &client_addr, bool keep_alive) {
+  if (path.compare("/status") == 0) {
+    handle_status_endpoint(server, response, client_addr, keep_alive);
+    server->metrics.count_route(path);
+    return 0;
+  }
 
-// Check if an IP address is rate limited based on the log table
-static bool is_rate_limited(https_server::ip_log_table_t &ip_log_table, const std::string &ip_address, unsigned long max_requests, time_t time_window) {
-  time_t current_time = time(nullptr);
-  auto &entry = ip_log_table[ip_address];
+  if (path.compare("/metrics") == 0) {
+    handle_metrics_endpoint(server, response, client_addr, keep_alive);
+    server->metrics.count_route(path);
+    return 200;
+  }
 
-  std::atomic<unsigned long> &request_count = entry.first;
-  std::atomic<time_t> &last_request_time = entry.second;
+  auto file = site.get_endpoint(path); // attempt to find route
 
-  // Atomically check and reset if outside time window
-  time_t last_time = last_request_time.load();
-  if (current_time - last_time > time_window) {
-    // Attempt to atomically update the timestamp
-    if (last_request_time.compare_exchange_strong(last_time, current_time)) {
-      // We won the race - reset the counter to 1 (this request)
-      request_count.store(1);
-      return false; // Not rate limited on reset
-    }
-    // Someone else reset it, fall through to increment
+  if (file.has_value()) { // route found, send contents
+    int status = add_negotiated_response(response, file->get(), request, keep_alive, true);
+    server->metrics.count_route(path);
+
+    const char *status_str = status == 304 ? "304 NOT MODIFIED" : status == 206 ? "206 PARTIAL CONTENT" : status == 416 ? "416 RANGE NOT SATISFIABLE" : "200 OK";
+    log_info("SERVER: INCOMING CONNECTION: %12s GET %.*s -> %s", inet_ntoa(client_addr), static_cast<int>(path.length()), path.data(), status_str);
+    return status;
   }
 
-  // Increment and check if over limit
-  unsigned long new_count = request_count.fetch_add(1) + 1;
-  return new_count > max_requests;
+  // no route found in config
+  add_negotiated_response(response, site.not_found, request, keep_alive, false);
+  log_info("SERVER: INCOMING CONNECTION: %12s GET %.*s -> 404 ERR NOT FOUND", inet_ntoa(client_addr), static_cast<int>(path.length()), path.data());
+  return 404;
 }
 
-// Handle the /status endpoint, returning server statistics in JSON format
-void handle_status_endpoint(const https_server *server, std::string &response, struct in_addr &client_addr) {
-  // Get system info
-  struct utsname sys_info;
-  uname(&sys_info);
-  std::string os_name = get_os_info();
+// Queue the answer to a request the parser rejected, the connection is closed after it
+static void add_error_response(output_queue &response, int code) {
+  const char *message = code == 431 ? "REQUEST HEADER FIELDS TOO LARGE" : code == 505 ? "HTTP VERSION NOT SUPPORTED" : "BAD REQUEST";
 
-  time_t uptime_seconds = time(nullptr) - server->start_time;
-  std::string uptime_str = format_uptime(uptime_seconds);
+  std::string error;
+  add_response_code(error, code, message);
+  add_header(error, "Content-Type", "text/plain");
+  add_body(error, std::to_string(code) + " - " + message, false);
+  response.append(error);
+}
 
-  std::string body = "{\n";
-  body +=            "  \"platform\": \"" + std::string(sys_info.sysname) + "\",\n";
-  body +=            "  \"os_version\": \"" + os_name + "\",\n";
-  body +=            "  \"server_version\": \"" + std::string(SERVER_VERSION) + "\",\n";
-  body +=            "  \"git_commit\": \"" + std::string(GIT_COMMIT_HASH) + "\",\n";
-  body +=            "  \"last_updated\": \"" + std::string(__DATE__) + " " + std::string(__TIME__) + "\",\n";
-  body +=            "  \"uptime\": \"" + uptime_str + "\",\n";
-  body +=            "  \"start_time\": \"" + format_timestamp(server->start_time) + "\",\n";
-  body +=            "  \"thread_count\": " + std::to_string(server->get_thread_count()) + ",\n";
-  body +=            "  \"total_requests\": " + std::to_string(server->total_requests) + ",\n";
-  body +=            "  \"valid_requests\": " + std::to_string(server->valid_request_count) + ",\n";
-  body +=            "  \"successful_requests\": " + std::to_string(server->successful_request_count) + ",\n";
-  body +=            "  \"rate_limited_requests\": " + std::to_string(get_rate_limited_count(server->ip_log_table, std::get<int>(server->get_config_value("rate_limit_max_requests", 100)))) + "\n";
-  body +=            "}\n";
-
-  add_response_code(response, 200, "OK");
-  add_header(response, "Content-Type", "application/json");
-  add_body(response, body);
-
-  // Count this as valid and successful (200 OK)
-  server->valid_request_count++;
-  server->successful_request_count++;
+// Build the response for one complete request head, appending it to response.
+// Returns whether the connection may be kept open afterwards.
+static bool handle_request(const https_server *server, const https_server::site &site, const http_request &request, output_queue &response,
+                           struct in_addr client_addr, bool allow_keep_alive) {
+  auto started = std::chrono::steady_clock::now();
+  bool keep_alive = allow_keep_alive && wants_keep_alive(request);
+  int status = 405;
 
-  log_info("SERVER: INCOMING CONNECTION: %12s GET /status -> 200 OK", inet_ntoa(client_addr));
+  /* build appropriate response */
+  if (request.method.compare("GET") == 0) {
+    status = handle_get_request(server, site, response, request, request.target, client_addr, keep_alive);
+  } else {
+    // Method not allowed for static site
+    std::string not_allowed;
+    add_response_code(not_allowed, 405, "METHOD NOT ALLOWED");
+    add_header(not_allowed, "Content-Type", "text/plain");
+    add_header(not_allowed, "Allow", "GET");
+    add_body(not_allowed, "405 - Method Not Allowed", keep_alive);
+    response.append(not_allowed);
+
+    std::string method(request.method), path(request.target);
+    const char* log_method = method.empty() ? "<empty>" : method.c_str();
+    const char* log_path = path.empty() ? "<empty>" : path.c_str();
+    log_info("SERVER: INCOMING CONNECTION: %12s %s %s -> 405 ERR METHOD NOT ALLOWED",
+             inet_ntoa(client_addr), log_method, log_path);
+  }
+
+  if (status != 0)
+    server->metrics.count_response(status);
+  server->metrics.observe(server_metrics::timer::request, std::chrono::steady_clock::now() - started);
+  return keep_alive;
 }
 
-//  handles one get request, querying the router, building an adequate response
-static void handle_get_request(const https_server *server, std::string &response, std::string &path, struct in_addr &client_addr) {
-  if (path.compare("/status") == 0) {
-    handle_status_endpoint(server, response, client_addr);
-    return;
+// Write everything queued to the client, waiting on the socket whenever it is full. File bodies
+// go through SSL_sendfile when the connection ended up with kernel TLS for sending.
+static bool ssl_write_all(SSL *ssl, int fd, output_queue &data, int timeout_ms) {
+  bool ktls = BIO_get_ktls_send(SSL_get_wbio(ssl));
+
+  while (!data.empty()) {
+    int bytes = data.write_to(ssl, ktls);
+    if (bytes <= 0 && (data.truncated() || !ssl_wait(ssl, fd, bytes, timeout_ms)))
+      return false;
   }
 
-  auto file = server->get_endpoint(path); // attempt to find route
+  return true;
+}
 
-  if (file.has_value()) { // route found, send contents
-    const auto& file_info = file->get();
-    add_response_code(response, 200, "OK");
-    add_header(response, "Content-Type", file_info.MIME_type);
-    add_body(response, file_info.contents);
-
-    // Count this as valid and successful (200 OK)
-    server->valid_request_count++;
-    server->successful_request_count++;
-
-    log_info("SERVER: INCOMING CONNECTION: %12s GET %s -> 200 OK", inet_ntoa(client_addr), path.c_str());
-  } else { // no route found in config
-    auto file_404 = server->get_endpoint("/404");
-
-    if (file_404.has_value()) {
-      const auto& file_404_info = file_404->get();
-      add_response_code(response, 404, "NOT FOUND");
-      add_header(response, "Content-Type", file_404_info.MIME_type);
-      add_body(response, file_404_info.contents);
+// Handle an incoming connection, this function will be called by one of the threads in the thread pool.
+// uses openSSL to read and write data to the client socket. The connection is kept open between
+// requests (HTTP/1.1 keep-alive) and pipelined requests are answered in order with one write.
+static void handle_connection(job_t::info_t job_info) {
+  std::string request;
+  http_parser parser = job_info.server->new_parser();
+  output_queue response;
+  std::shared_ptr<const https_server::site> site;
+  char recv_buf[MAX_LINE];
+  int n, served = 0;
+  bool keep_alive = true;
+
+  const server_config &config = job_info.server->get_config();
+  int timeout_ms = config.client_timeout.count();
+  int idle_timeout_ms = config.keep_alive_timeout.count();
+  std::unique_ptr<http2_session> http2 = job_info.server->new_http2_session(job_info.ssl);
+
+  while (keep_alive) {
+    /* answer every complete request already buffered */
+    if (http2) {
+      keep_alive = job_info.server->serve_http2(request, *http2, response, site, served, job_info.client_addr.sin_addr);
     } else {
-      // Fallback if /404 route doesn't exist
-      add_response_code(response, 404, "NOT FOUND");
-      add_header(response, "Content-Type", "text/plain");
-      add_body(response, "404 - Page Not Found");
+      keep_alive = job_info.server->serve_requests(request, parser, response, site, served, job_info.client_addr.sin_addr);
     }
 
-    // Count this as valid but not successful (404)
-    server->valid_request_count++;
+    /* write responses back to client */
+    if (!response.empty()) {
+      if (!ssl_write_all(job_info.ssl, job_info.client_fd, response, timeout_ms)) {
+        log_info("SERVER: ERROR: Failed to send response to client %s, %s", inet_ntoa(job_info.client_addr.sin_addr), ERR_error_string(ERR_get_error(), nullptr));
+        break;
+      }
+    }
 
-    log_info("SERVER: INCOMING CONNECTION: %12s GET %s -> 404 ERR NOT FOUND", inet_ntoa(client_addr), path.c_str());
-  }
-}
+    if (!keep_alive)
+      break;
 
-// Handle an incoming connection, this function will be called by one of the threads in the thread pool.
-// uses openSSL to read and write data to the client socket.
-static void handle_connection(job_t::info_t job_info) {
-  std::string request, response, path, method;
-  char recv_buf[MAX_LINE + 1];
-  int n, recv_bytes = 0;
+    /* HTTP/2 bodies held back to bound the queue go out before waiting on the client again */
+    if (http2 && http2->can_send())
+      continue;
 
-  /* read in request */
-  memset(recv_buf, 0x00, MAX_LINE + 1);
-  while ((n = SSL_read(job_info.ssl, recv_buf, MAX_LINE)) > 0) {
-    request.append(recv_buf, n);
-    recv_bytes += n;
+    /* read in more of the next request, idle connections get the shorter keep-alive timeout */
+    n = SSL_read(job_info.ssl, recv_buf, sizeof(recv_buf));
+    if (n <= 0) {
+      if (ssl_wait(job_info.ssl, job_info.client_fd, n, request.empty() && served > 0 ? idle_timeout_ms : timeout_ms))
+        continue; // socket is ready again, retry the read
 
-    if (recv_buf[n - 1] == '\n') // check for end of request
+      if (served == 0) {
+        log_info("SERVER: INCOMING CONNECTION: %12s - Empty or malformed request received. dropping connection.", inet_ntoa(job_info.client_addr.sin_addr));
+      }
       break;
+    }
 
-    memset(recv_buf, 0x00, MAX_LINE);
+    request.append(recv_buf, n);
   }
 
-  if (recv_bytes <= 0) {
-    log_info("SERVER: INCOMING CONNECTION: %12s - Empty or malformed request received. dropping connection.", inet_ntoa(job_info.client_addr.sin_addr));
-    ssl_shutdown_wrapper(job_info.ssl);
-    close(job_info.client_fd);
+  /* close connection */
+  ssl_shutdown_wrapper(job_info.ssl);
+  close(job_info.client_fd);
+}
 
-    return;
+// Complete the TLS handshake before the deadline, logging why it failed otherwise
+static bool accept_tls(const job_t::info_t &job_info, std::chrono::steady_clock::time_point deadline) {
+  int accept_result;
+  while ((accept_result = SSL_accept(job_info.ssl)) != 1) {
+    if (ssl_wait(job_info.ssl, job_info.client_fd, accept_result, remaining_ms(deadline)))
+      continue; // handshake needs another round trip
+
+    int ssl_error = SSL_get_error(job_info.ssl, accept_result);
+    unsigned long err_code = ERR_get_error();
+    char err_buf[256];
+    ERR_error_string_n(err_code, err_buf, sizeof(err_buf));
+
+    log_info("SERVER: SSL handshake failed for client %s - SSL_error: %d, Error: %s",
+             inet_ntoa(job_info.client_addr.sin_addr), ssl_error, err_buf);
+    return false;
   }
 
-  /* Process Request */
-  get_req_info(request, method, path); // get path and method
+  return true;
+}
 
-  /* build appropriate response */
-  if (method.compare("GET") == 0) {
-    handle_get_request(job_info.server, response, path, job_info.client_addr.sin_addr);
-  } else {
-    // Method not allowed for static site
-    add_response_code(response, 405, "METHOD NOT ALLOWED");
-    add_header(response, "Content-Type", "text/plain");
-    add_header(response, "Allow", "GET");
-    add_body(response, "405 - Method Not Allowed");
+// Turn away a connection that sat in the queue too long. By default it is closed before any TLS
+// work; with overload_response=503 it gets a brief handshake and the prebuilt 503 instead.
+static void shed_connection(job_t::info_t job_info) {
+  job_info.server->shed_queue_wait++;
+  log_info("SERVER: INCOMING CONNECTION: %12s - Queued too long, shedding connection.", inet_ntoa(job_info.client_addr.sin_addr));
+
+  const std::string &unavailable = job_info.server->get_unavailable_response();
+  if (!unavailable.empty()) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHED_TIMEOUT_MS);
+    if (accept_tls(job_info, deadline)) {
+      output_queue response;
+      response.append_ref(unavailable);
+      if (ssl_write_all(job_info.ssl, job_info.client_fd, response, remaining_ms(deadline))) {
+        job_info.server->metrics.count_response(503);
+        SSL_shutdown(job_info.ssl); // close_notify only, the SSL is freed below either way
+      }
+    }
+  }
 
-    // 405 is a valid response to a malformed/unsupported request
-    job_info.server->valid_request_count++;
+  SSL_free(job_info.ssl);
+  close(job_info.client_fd);
+}
 
-    const char* log_method = method.empty() ? "<empty>" : method.c_str();
-    const char* log_path = path.empty() ? "<empty>" : path.c_str();
-    log_info("SERVER: INCOMING CONNECTION: %12s %s %s -> 405 ERR METHOD NOT ALLOWED",
-             inet_ntoa(job_info.client_addr.sin_addr), log_method, log_path);
+// Complete the TLS handshake for a freshly accepted connection, then serve it. Runs on a pool worker
+// so a slow or stalled handshake only ever occupies one worker instead of the accept thread.
+static void handle_handshake(job_t::info_t job_info) {
+  const server_config &config = job_info.server->get_config();
+  auto started = std::chrono::steady_clock::now();
+  job_info.server->metrics.observe(server_metrics::timer::queue_wait, started - job_info.queued_at);
+
+  if (config.max_queue_wait.count() > 0 && started - job_info.queued_at > config.max_queue_wait) {
+    shed_connection(job_info);
+    return;
   }
 
-  /* write response back to client */
-  int bytes = SSL_write(job_info.ssl, response.c_str(), response.length());
-  if (bytes <= 0) {
-    log_info("SERVER: ERROR: Failed to send response to client %s, %s", inet_ntoa(job_info.client_addr.sin_addr), ERR_error_string(ERR_get_error(), nullptr));
+  auto deadline = started + config.client_timeout;
+
+  if (!accept_tls(job_info, deadline)) {
+    /* SSL handshake failed or timed out, clean up resources */
+    SSL_free(job_info.ssl);
+    close(job_info.client_fd);
+    return;
   }
 
-  /* close connection */
-  ssl_shutdown_wrapper(job_info.ssl);
-  close(job_info.client_fd);
+  job_info.server->count_handshake(job_info.ssl, started);
+  if (BIO_get_ktls_send(SSL_get_wbio(job_info.ssl)))
+    job_info.server->ktls_connections++;
+
+  handle_connection(job_info);
 }
 
 
@@ -359,48 +805,272 @@ static void handle_connection(job_t::info_t job_info) {
 **************************************/
 
 https_server::https_server() : start_time(time(nullptr)) {
-  this->populate_config();
-
-  // Create thread pool with configured size
-  int thread_count = std::get<int>(this->get_config_value("thread_pool_size", 0));
-  this->pool = std::make_unique<thread_pool>(thread_count);
+  signal(SIGPIPE, SIG_IGN); // a client closing mid-write must not kill the server
+
+  // SIGHUP reloads config and routes, the handler only wakes the watcher thread
+  error_check(pipe2(reload_pipe, O_NONBLOCK | O_CLOEXEC), "Unable to create reload pipe");
+  struct sigaction reload_action = {};
+  reload_action.sa_handler = request_reload;
+  reload_action.sa_flags = SA_RESTART;
+  sigaction(SIGHUP, &reload_action, nullptr);
+
+  // invalid config values throw here, so a bad config file stops the server at startup
+  auto initial = std::make_shared<site>();
+  this->populate_config(*initial); // without a config file every key takes its default
+  this->populate_router(*initial);
+  this->publish_site(initial);
+  const server_config &config = initial->config;
+
+  configure_logging(config.log_flush_interval.count(), config.log_max_size, config.log_max_segments);
+  add_rotated_log("../logs/reboot.log"); // written by on_reboot.sh
+
+  this->limiter = std::make_unique<rate_limiter>(config.rate_limit_max_requests,
+                                                 std::chrono::duration_cast<std::chrono::seconds>(config.rate_limit_time_window).count(),
+                                                 config.rate_limit_ipv4_prefix,
+                                                 config.rate_limit_ipv6_prefix);
 
-  this->populate_router();
   this->create_SSL_context();
   this->configure_SSL_context();
 
-  this->socket_fd = this->create_server_socket();
-  this->main_loop();
+  // Create the configured I/O engine
+  if (config.io_engine == io_engine_type::reactor) {
+    int reactor_count = config.reactor_threads;
+    if (reactor_count <= 0)
+      reactor_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 0; i < reactor_count; ++i) {
+      this->reactors.push_back(std::make_unique<reactor>(this, i));
+    }
+  } else {
+    // Create thread pool with configured size and queue bound
+    this->pool = std::make_unique<thread_pool>(config.thread_pool_size, config.max_queue_depth);
+
+    // with overload_response=503 shed connections are told when to come back instead of being closed
+    if (config.overload_response == overload_action::unavailable) {
+      add_response_code(this->unavailable_response, 503, "SERVICE UNAVAILABLE");
+      add_header(this->unavailable_response, "Retry-After", std::to_string(std::chrono::duration_cast<std::chrono::seconds>(config.retry_after).count()));
+      add_header(this->unavailable_response, "Content-Type", "text/plain");
+      add_body(this->unavailable_response, "503 - SERVICE UNAVAILABLE", false);
+    }
+  }
+
+  // Open the listening sockets, with more than one they share the port through SO_REUSEPORT
+  // and the kernel spreads new connections across their accept threads
+  int listener_count = config.listener_threads;
+  if (listener_count <= 0)
+    listener_count = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 0; i < listener_count; ++i) {
+    this->listen_fds.push_back(this->create_server_socket(listener_count > 1));
+  }
+
+  this->status_fields = serialize_static_status(this->pool ? "pool" : "reactor", this->get_thread_count(), this->listen_fds.size(), this->start_time);
+
+  this->maintenance = std::thread(&https_server::maintenance_loop, this);
+  this->watcher = std::thread(&https_server::watch_loop, this);
+
+  std::vector<std::thread> listeners;
+  for (int i = 0; i < listener_count; ++i) {
+    listeners.emplace_back(&https_server::main_loop, this, i);
+    if (listener_count > 1)
+      pin_thread(listeners.back(), i);
+  }
+
+  for (auto &listener : listeners) {
+    listener.join();
+  }
 }
 
 https_server::~https_server() {
   log_info("SERVER: Cleaning up resources and closing connections");
-  close(this->socket_fd);
+  {
+    std::lock_guard<std::mutex> lock(this->maintenance_mutex);
+    this->stopping = true;
+  }
+  this->maintenance_cv.notify_all();
+  if (this->maintenance.joinable())
+    this->maintenance.join();
+
+  request_reload(0); // wakes the watcher, which sees stopping and exits
+  if (this->watcher.joinable())
+    this->watcher.join();
+
+  for (int listen_fd : this->listen_fds) {
+    close(listen_fd);
+  }
   close_log_file();
 }
 
-// Searches the server's internal routing hash map, returning any matches
-std::optional<std::reference_wrapper<const https_server::file_info>> https_server::get_endpoint(const std::string &path) const {
-  auto route = this->routing.find(path);
-  if (route == end(this->routing)) {
+// Searches the site's routing table, returning any matches
+std::optional<std::reference_wrapper<const https_server::file_info>> https_server::site::get_endpoint(std::string_view path) const {
+  uint32_t index = this->routes.find(path);
+  if (index == route_table::npos) {
     return std::nullopt;
   }
 
-  return std::cref(route->second);
+  return std::cref(this->files[index]);
 }
 
-// Create the server's listening socket
-int https_server::create_server_socket() {
+// The site this thread last saw. Readers only compare the generation counter, site_mutex is
+// taken once per thread after each reload to pick up the new site. An idle thread keeps the
+// previous site alive until it next serves something.
+const std::shared_ptr<const https_server::site> &https_server::cached_site() const {
+  struct cache {
+    const https_server *server = nullptr;
+    unsigned long generation = 0;
+    std::shared_ptr<const site> current;
+  };
+  thread_local cache cached;
+
+  unsigned long generation = this->site_generation.load(std::memory_order_acquire);
+  if (cached.server != this || cached.generation != generation) {
+    std::lock_guard<std::mutex> lock(this->site_mutex);
+    cached.current = this->published_site;
+    cached.generation = this->site_generation.load(std::memory_order_relaxed);
+    cached.server = this;
+  }
+
+  return cached.current;
+}
+
+std::shared_ptr<const https_server::site> https_server::get_site() const {
+  return this->cached_site();
+}
+
+// Make next the current site. The previous one is freed once the last request using it is done.
+void https_server::publish_site(std::shared_ptr<const site> next) {
+  std::shared_ptr<const site> previous;
+  { // after the mutex goes out of scope it is released
+    std::lock_guard<std::mutex> lock(this->site_mutex);
+    previous = std::move(this->published_site);
+    this->published_site = std::move(next);
+    this->site_generation.fetch_add(1, std::memory_order_release);
+  }
+}
+
+// Build a new site from the files on disk and publish it. Keys read only at startup (ports,
+// threads, I/O engine, TLS, logging, rate limits) keep their values until the next restart.
+void https_server::reload() {
+  log_info("SERVER: Reloading configuration and routes");
+
+  try {
+    auto next = std::make_shared<site>();
+    if (!this->populate_config(*next)) {
+      log_info("ERROR: Reload failed, keeping the current configuration");
+      return;
+    }
+
+    this->populate_router(*next);
+    size_t route_count = next->routes.size();
+    this->publish_site(std::move(next));
+    log_info("SERVER: Reload complete, serving %zu routes", route_count);
+  } catch (const std::exception &e) {
+    log_info("ERROR: Reload failed, keeping the current configuration: %s", e.what());
+  }
+}
+
+// Answer every complete request head buffered in request, appending the responses to response.
+// Shared by both I/O engines. Returns false once the connection must close after writing them.
+bool https_server::serve_requests(std::string &request, http_parser &parser, output_queue &response, std::shared_ptr<const site> &pinned,
+                                  int &served, struct in_addr client_addr) const {
+  // move to the newest site only once nothing queued still points into the old one
+  if (!pinned || response.empty())
+    pinned = this->cached_site();
+
+  int max_requests = pinned->config.keep_alive_max_requests;
+  http_request head;
+  size_t consumed = 0;
+  bool keep_alive = true;
+
+  // the parsed views point into request, so it is only trimmed once everything buffered is answered
+  while (keep_alive) {
+    http_parser::status status = parser.parse(std::string_view(request).substr(consumed), head);
+    if (status == http_parser::status::incomplete)
+      break;
+
+    if (status == http_parser::status::error) {
+      add_error_response(response, parser.error_code());
+      this->metrics.count_response(parser.error_code());
+      log_info("SERVER: INCOMING CONNECTION: %12s - Malformed or oversized request, answered %d and closing connection.", inet_ntoa(client_addr), parser.error_code());
+      keep_alive = false;
+      break;
+    }
+
+    keep_alive = handle_request(this, *pinned, head, response, client_addr, ++served < max_requests);
+    consumed += parser.head_length();
+    parser.reset();
+  }
+
+  request.erase(0, consumed);
+  return keep_alive;
+}
+
+// Answer every request whose frames are buffered in request and queue the frames to send. Each
+// stream is answered by handle_request as if it were an HTTP/1.1 request, the session translates
+// the response. After keep_alive_max_requests streams the connection is wound down with a GOAWAY.
+bool https_server::serve_http2(std::string &request, http2_session &session, output_queue &response, std::shared_ptr<const site> &pinned,
+                               int &served, struct in_addr client_addr) const {
+  // stream bodies still being sent point into the pinned site as well
+  if (!pinned || (response.empty() && !session.has_pending()))
+    pinned = this->cached_site();
+
+  const site &current = *pinned;
+  http2_session::responder respond = [&](const http_request &head, output_queue &stream_response) {
+    handle_request(this, current, head, stream_response, client_addr, false);
+    if (++served == current.config.keep_alive_max_requests)
+      session.go_away();
+  };
+
+  return session.process(request, response, respond);
+}
+
+// Record a completed handshake: its duration, protocol version, cipher and whether it was resumed
+void https_server::count_handshake(SSL *ssl, std::chrono::steady_clock::time_point started) const {
+  this->metrics.observe(server_metrics::timer::handshake, std::chrono::steady_clock::now() - started);
+  this->metrics.count_handshake(SSL_get_version(ssl), SSL_CIPHER_get_name(SSL_get_current_cipher(ssl)), SSL_session_reused(ssl));
+}
+
+// A parser enforcing the configured request head limits
+http_parser https_server::new_parser() const {
+  const server_config &config = this->get_config();
+  return http_parser(config.max_request_head, config.max_request_headers);
+}
+
+// A session for a connection whose handshake chose h2 through ALPN
+std::unique_ptr<http2_session> https_server::new_http2_session(SSL *ssl) const {
+  const unsigned char *protocol;
+  unsigned int length;
+  SSL_get0_alpn_selected(ssl, &protocol, &length);
+  if (length != 2 || memcmp(protocol, "h2", 2) != 0)
+    return nullptr;
+
+  this->http2_connections++;
+  const server_config &config = this->get_config();
+  http2_session::settings local;
+  local.max_concurrent_streams = config.http2_max_streams;
+  local.max_header_list_size = config.max_request_head;
+  return std::make_unique<http2_session>(local);
+}
+
+// Create one of the server's listening sockets
+int https_server::create_server_socket(bool reuse_port) {
   int listen_fd;
   struct sockaddr_in servaddr;
 
   // Get config values
-  int port = std::get<int>(this->get_config_value("server_port", 443));
-  int backlog = std::get<int>(this->get_config_value("backlog", 1000));
+  int port = this->get_config().server_port;
+  int backlog = this->get_config().backlog;
 
   // create the socket
   error_check((listen_fd = socket(AF_INET, SOCK_STREAM, 0)), "Socket error");
 
+  // allow quick restarts, and several listeners on one port when sharding accepts
+  int enable = 1;
+  error_check(setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)), "SO_REUSEADDR error");
+  if (reuse_port) {
+    error_check(setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)), "SO_REUSEPORT error");
+  }
+
   // setup address
   bzero(&servaddr, sizeof(struct sockaddr_in));
   servaddr.sin_family = AF_INET;
@@ -417,43 +1087,44 @@ int https_server::create_server_socket() {
   return listen_fd;
 }
 
-// Main loop of the server, waits for connections and attempts to establish a secure connection
-void https_server::main_loop() {
+// Main loop of one listener, waits for connections and hands them to the I/O engine for the TLS handshake
+void https_server::main_loop(int listener) {
   struct sockaddr_in client_addr;
   socklen_t client_len = sizeof(client_addr);
 
-  int last_culled = 0;
+  // a listener feeds the reactor on its own core when there is one per listener
+  bool own_reactor = this->reactors.size() == this->listen_fds.size();
+  size_t next_reactor = listener;
 
   for (;;) {
     // Accept incoming connections
-    int client_fd = accept(this->socket_fd, (struct sockaddr*)&client_addr, &client_len); /* blocks until request */
-    this->total_requests++; // increment total requests on every connection attempt
-
-    // Cull log file every 100 requests if it exceeds max size
-    if (this->total_requests.load() - last_culled >= 100) {
-      cull_log_file(std::get<int>(this->get_config_value("log_max_size", 52428800))); // default 50MB
-      cull_log_file(std::get<int>(this->get_config_value("log_max_size", 52428800)), "../logs/reboot.log");
-
-      cull_ip_log_table(this->ip_log_table, time(nullptr), std::get<int>(this->get_config_value("ip_log_cull_threshold", 3600))); // default 1 hour
-      log_ip_table_csv(this->ip_log_table, "../logs/ip_log.csv");
+    int client_fd = accept(this->listen_fds[listener], (struct sockaddr*)&client_addr, &client_len); /* blocks until request */
+    this->metrics.count_connection(); // every connection attempt, refused ones included
 
-      last_culled = this->total_requests.load();
+    if (client_fd < 0) {
+      log_info("SERVER: ERROR: Accept failed: %s", strerror(errno));
+      continue;
     }
 
-    // Check rate limiting (this also increments the IP table counter)
-    if (is_rate_limited(this->ip_log_table, inet_ntoa(client_addr.sin_addr),
-                        std::get<int>(this->get_config_value("rate_limit_max_requests", 100)),
-                        std::get<int>(this->get_config_value("rate_limit_time_window", 60)))) {
+    // Check rate limiting (this also records the client in the IP table)
+    if (!this->limiter->allow(client_addr.sin_addr)) {
       log_info("SERVER: INCOMING CONNECTION: %12s - Rate limit exceeded, dropping connection.", inet_ntoa(client_addr.sin_addr));
       close(client_fd);
       continue;
     }
 
-    if (client_fd < 0) {
-      log_info("SERVER: ERROR: Accept failed: %s", strerror(errno));
+    // handshakes are driven by the workers, never block the accept thread on a client
+    if (!set_nonblocking(client_fd)) {
+      log_info("SERVER: ERROR: Unable to make socket non-blocking for client %s, dropping connection.", inet_ntoa(client_addr.sin_addr));
+      close(client_fd);
       continue;
     }
 
+    // a response goes out as several writes (head, then body chunks or HTTP/2 frames), Nagle would
+    // hold each small one back until the client's delayed ACK for the previous
+    int enable = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
     /* set up ssl for socket */
     SSL *ssl = SSL_new(this->ssl_ctx.get());
     if (!ssl) {
@@ -464,34 +1135,181 @@ void https_server::main_loop() {
     
     SSL_set_fd(ssl, client_fd);
 
-    int accept_result = SSL_accept(ssl);
-    if (accept_result == 1) {
-      /* submit job */
-      job_t job = {
-        {
-          this,
-          client_addr,
-          ssl,
-          client_fd
-        },
-        handle_connection
-      };
-
-      this->pool->queue_job(job);
+    job_t::info_t info = {
+      this,
+      client_addr,
+      ssl,
+      client_fd,
+      std::chrono::steady_clock::now()
+    };
+
+    if (!this->reactors.empty()) {
+      /* hand the connection to the next event loop, it drives the handshake from there */
+      size_t target = own_reactor ? listener : next_reactor++ % this->reactors.size();
+      this->reactors[target]->add_connection(info);
     } else {
-      /* SSL handshake failed, clean up resources */
-      int ssl_error = SSL_get_error(ssl, accept_result);
-      unsigned long err_code = ERR_get_error();
-      char err_buf[256];
-      ERR_error_string_n(err_code, err_buf, sizeof(err_buf));
+      /* submit job, the handshake is completed by the worker */
+      if (!this->pool->queue_job({ info, handle_handshake })) {
+        /* every worker is busy and the queue is full, refuse before spending anything on TLS */
+        this->shed_queue_full++;
+        log_info("SERVER: INCOMING CONNECTION: %12s - Queue full, shedding connection.", inet_ntoa(client_addr.sin_addr));
+        SSL_free(ssl);
+        close(client_fd);
+      }
+    }
+  }
+}
 
-      log_info("SERVER: SSL handshake failed for client %s - SSL_error: %d, Error: %s",
-               inet_ntoa(client_addr.sin_addr), ssl_error, err_buf);
+// Background maintenance, every ip_snapshot_interval seconds forget idle clients and write a
+// binary snapshot of the IP table, so the accept threads never walk the table themselves
+void https_server::maintenance_loop() {
+  const std::string snapshot_path = "../logs/ip_log.bin";
+  auto interval = this->get_config().ip_snapshot_interval;
+  time_t cull_threshold = std::chrono::duration_cast<std::chrono::seconds>(this->get_config().ip_log_cull_threshold).count();
 
-      SSL_free(ssl);
-      close(client_fd);
+  std::unique_lock<std::mutex> lock(this->maintenance_mutex);
+  while (!this->maintenance_cv.wait_for(lock, interval, [this] { return this->stopping; })) {
+    size_t removed = this->limiter->cull(time(nullptr), cull_threshold);
+    std::vector<rate_limit_record> records = this->limiter->snapshot();
+
+    if (!write_ip_snapshot(records, snapshot_path)) {
+      log_info("ERROR: Unable to write IP table snapshot to %s", snapshot_path.c_str());
+      continue;
+    }
+
+    log_info("SERVER: Wrote IP table snapshot to %s with %zu entries (%zu culled)", snapshot_path.c_str(), records.size(), removed);
+  }
+}
+
+// Every regular file below directory as a path relative to it, sorted, and optionally every
+// subdirectory. Hidden entries and symbolic links are skipped, so a mount never serves dotfiles or
+// reaches outside its directory.
+static bool list_directory(const std::string &directory, std::vector<std::string> &files, std::vector<std::string> *subdirectories = nullptr) {
+  namespace fs = std::filesystem;
+  std::error_code error;
+
+  fs::recursive_directory_iterator entry(directory, error), end;
+  for (; !error && entry != end; entry.increment(error)) {
+    if (entry->path().filename().string()[0] == '.') {
+      entry.disable_recursion_pending();
+      continue;
+    }
+
+    if (entry->is_symlink(error))
+      continue;
+    if (entry->is_regular_file(error))
+      files.push_back(entry->path().lexically_relative(directory).generic_string());
+    else if (subdirectories && entry->is_directory(error))
+      subdirectories->push_back(entry->path().generic_string());
+  }
+
+  std::sort(files.begin(), files.end());
+  return !error;
+}
+
+// Watch the directories holding the config file, the routing file and every routed file, and every
+// mounted directory tree. Returns the inotify descriptor and fills watched with the file names of
+// interest under each watch, "" standing for any name in a mounted directory.
+static int watch_site_files(const https_server::site &site, std::unordered_map<int, std::unordered_set<std::string>> &watched) {
+  int notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (notify_fd < 0) {
+    log_info("ERROR: Unable to watch files for changes: %s", strerror(errno));
+    return -1;
+  }
+
+  std::vector<std::pair<std::string, std::string>> targets = { // directory and file name
+    { parent_directory(CONFIG_PATH), file_name(CONFIG_PATH) },
+    { parent_directory(site.config.router_config_path), file_name(site.config.router_config_path) }
+  };
+  for (const auto &file : site.files) {
+    targets.emplace_back(parent_directory(file.path), file_name(file.path));
+  }
+
+  // files added anywhere below a mount become new routes
+  for (const std::string &mount : site.mounts) {
+    std::vector<std::string> files, subdirectories;
+    list_directory(mount, files, &subdirectories);
+    targets.emplace_back(mount, "");
+    for (const std::string &subdirectory : subdirectories) {
+      targets.emplace_back(subdirectory, "");
+    }
+  }
+
+  // editors often save by renaming a new file over the old one, so watch directories rather than files
+  watched.clear();
+  for (const auto &[directory, name] : targets) {
+    int wd = inotify_add_watch(notify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_CREATE);
+    if (wd < 0) {
+      log_info("ERROR: Unable to watch %s for changes: %s", directory.c_str(), strerror(errno));
+      continue;
     }
+    watched[wd].insert(name);
   }
+
+  return notify_fd;
+}
+
+// Reload on SIGHUP, and with watch_files when a file the site was built from changes. Changes are
+// collected until RELOAD_SETTLE_MS pass without another, so saving several files reloads once.
+void https_server::watch_loop() {
+  std::unordered_map<int, std::unordered_set<std::string>> watched; // watch descriptor -> file names
+  int notify_fd = -1;
+  bool rearm = true, pending = false;
+
+  for (;;) {
+    // the files to watch change with the routes, start over after every reload
+    if (rearm) {
+      if (notify_fd >= 0)
+        close(notify_fd);
+      notify_fd = this->get_config().watch_files ? watch_site_files(*this->cached_site(), watched) : -1;
+      rearm = false;
+    }
+
+    struct pollfd fds[2] = { { reload_pipe[0], POLLIN, 0 }, { notify_fd, POLLIN, 0 } }; // poll skips fd -1
+    int n = poll(fds, 2, pending ? RELOAD_SETTLE_MS : -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      log_info("ERROR: Reload watcher stopped: %s", strerror(errno));
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char drain[64];
+      while (read(reload_pipe[0], drain, sizeof(drain)) > 0) {} // several signals reload once
+
+      { // after the mutex goes out of scope it is released
+        std::lock_guard<std::mutex> lock(this->maintenance_mutex);
+        if (this->stopping)
+          break;
+      }
+      pending = true;
+      n = 0; // a signal reloads straight away
+    }
+
+    if (notify_fd >= 0 && (fds[1].revents & POLLIN)) {
+      alignas(struct inotify_event) char events[4096];
+      ssize_t length;
+      while ((length = read(notify_fd, events, sizeof(events))) > 0) {
+        for (char *next = events; next < events + length; ) {
+          auto *event = reinterpret_cast<struct inotify_event *>(next);
+          auto names = watched.find(event->wd);
+          if (event->len > 0 && names != watched.end() && (names->second.count("") > 0 || names->second.count(event->name) > 0))
+            pending = true;
+          next += sizeof(struct inotify_event) + event->len;
+        }
+      }
+    }
+
+    if (n == 0 && pending) {
+      pending = false;
+      this->reload();
+      rearm = true;
+    }
+  }
+
+  if (notify_fd >= 0)
+    close(notify_fd);
 }
 
 // Creates an SSL context and error checks
@@ -505,24 +1323,132 @@ void https_server::create_SSL_context() {
   this->ssl_ctx.reset(ctx);
 }
 
+// ALPN protocols in order of preference, as length-prefixed names
+static const unsigned char alpn_http2[] = "\x02h2\x08http/1.1";
+static const unsigned char alpn_http1[] = "\x08http/1.1";
+
+// Pick the application protocol from the client's ALPN list. arg is one of the lists above. h2
+// needs TLS 1.2 or later; a client offering nothing we speak carries on without ALPN and gets HTTP/1.1.
+static int select_protocol(SSL *ssl, const unsigned char **out, unsigned char *out_length, const unsigned char *in, unsigned int in_length, void *arg) {
+  const unsigned char *offered = static_cast<const unsigned char *>(arg);
+  if (SSL_version(ssl) < TLS1_2_VERSION)
+    offered = alpn_http1;
+
+  unsigned int offered_length = offered == alpn_http2 ? sizeof(alpn_http2) - 1 : sizeof(alpn_http1) - 1;
+  unsigned char *selected;
+  if (SSL_select_next_proto(&selected, out_length, offered, offered_length, in, in_length) != OPENSSL_NPN_NEGOTIATED)
+    return SSL_TLSEXT_ERR_NOACK;
+
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
 // Load certificates and keys
 void https_server::configure_SSL_context() {
-  error_check(SSL_CTX_use_certificate_chain_file(this->ssl_ctx.get(), std::get<std::string>(this->get_config_value("ssl_cert_path", "./secret/server.crt")).c_str()), "Failed to load certificate.");
-  error_check(SSL_CTX_use_PrivateKey_file(this->ssl_ctx.get(), std::get<std::string>(this->get_config_value("ssl_key_path", "./secret/server.key")).c_str(), SSL_FILETYPE_PEM), "Unable to load key file.");
+  const server_config &config = this->get_config();
+  error_check(SSL_CTX_use_certificate_chain_file(this->ssl_ctx.get(), config.ssl_cert_path.c_str()), "Failed to load certificate.");
+  error_check(SSL_CTX_use_PrivateKey_file(this->ssl_ctx.get(), config.ssl_key_path.c_str(), SSL_FILETYPE_PEM), "Unable to load key file.");
+
+  // Kernel TLS is opt-in. OpenSSL only switches a connection over when the kernel module and the
+  // negotiated cipher allow it, every other connection keeps encrypting in userspace.
+  if (config.ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(this->ssl_ctx.get(), SSL_OP_ENABLE_KTLS);
+    log_info("SERVER: Kernel TLS offload enabled where supported");
+#else
+    log_info("CONFIG: ktls requested but this OpenSSL build has no kernel TLS support");
+#endif
+  }
+
+  // Session resumption, returning clients skip the certificate signature and key exchange of a full handshake
+  auto lifetime = std::chrono::duration_cast<std::chrono::seconds>(config.ssl_session_timeout);
+  if (config.ssl_session_tickets) {
+    this->tickets = std::make_unique<ticket_keys>(std::chrono::duration_cast<std::chrono::seconds>(config.ssl_ticket_key_rotation), lifetime);
+  }
+  configure_session_resumption(this->ssl_ctx.get(), config.ssl_session_cache_size, lifetime, this->tickets.get());
+  log_info("SERVER: Session resumption with a %d session cache%s", config.ssl_session_cache_size,
+           this->tickets ? " and rotating ticket keys" : ", tickets off");
+
+  // Clients that offer h2 get HTTP/2, everyone else HTTP/1.1
+  SSL_CTX_set_alpn_select_cb(this->ssl_ctx.get(), select_protocol, const_cast<unsigned char *>(config.http2 ? alpn_http2 : alpn_http1));
+  log_info("SERVER: ALPN offers %s", config.http2 ? "h2 and http/1.1" : "http/1.1 only");
+}
+
+// Read a routed file and prepare everything served from it: validators, precompressed variants
+// and pre-serialized headers. nullopt if the file cannot be read.
+static std::optional<https_server::file_info> load_file(const std::string &path, const std::string &MIME_type, const server_config &config, time_t fallback_mtime) {
+  https_server::file_info file;
+  file.path = path;
+  file.MIME_type = MIME_type;
+
+  // load file content, large files stay mapped and are streamed from the page cache
+  file.data = asset::load(file.path, config.stream_threshold);
+  if (!file.data)
+    return std::nullopt;
+  file.contents = file.data->data();
+
+  // validators for conditional requests
+  struct stat file_stat;
+  file.last_modified = stat(file.path.c_str(), &file_stat) == 0 ? file_stat.st_mtime : fallback_mtime;
+  file.last_modified_str = format_http_date(file.last_modified);
+  file.etag = file.data->is_mapped() ? make_mapped_etag(file.contents) : make_etag(file.contents);
+  if (file.etag.empty()) {
+    log_info("ROUTER: %s was truncated while loading, skipping it.", file.path.c_str());
+    return std::nullopt;
+  }
+
+  // precompress text-like routes once, keeping only variants that actually save bytes
+  if (config.precompress && !file.data->is_mapped() && is_compressible(file.MIME_type)) {
+    for (const auto &encoding : available_encodings()) {
+      auto compressed = compress(encoding, file.contents);
+      if (compressed.has_value() && compressed->length() < file.contents.length()) {
+        file.variants.push_back({ encoding, std::move(*compressed), "", "", make_etag(file.contents, encoding) });
+      }
+    }
+
+    std::sort(file.variants.begin(), file.variants.end(), [](const auto &a, const auto &b) {
+      return a.contents.length() < b.contents.length();
+    });
+  }
+
+  file.header = build_cached_header(200, "OK", file);
+  file.not_modified_header = build_not_modified_header(file);
+  for (auto &variant : file.variants) {
+    variant.header = build_cached_header(200, "OK", file, &variant);
+    variant.not_modified_header = build_not_modified_header(file, &variant);
+  }
+
+  return file;
 }
 
-// Searches the default routing config file, populating the hash map with valid routes,
-// if a route is not in the hash map, the route will not be served.
-void https_server::populate_router() {
+// Searches the default routing config file, loading every listed file and every file under a
+// mounted directory. Only routes found here are ever served, requests never reach the filesystem.
+void https_server::populate_router(site &next) const {
   std::ifstream fp;
 
   // open routing config file
-  std::string router_path = std::get<std::string>(this->get_config_value("router_config_path", "./public/endpoints.conf"));
+  const std::string &router_path = next.config.router_config_path;
   fp.open(router_path);
   if (!fp) {
     throw std::runtime_error("Failed to open routing config file at path: " + router_path);
   }
 
+  std::vector<std::pair<std::string, uint32_t>> listed, mounted; // listed routes win over mounted ones
+  std::unordered_map<std::string, uint32_t> loaded; // path and MIME type -> index into next.files
+
+  // load a file once, however many routes lead to it
+  auto add_file = [&](const std::string &path, const std::string &MIME_type) -> uint32_t {
+    auto [it, inserted] = loaded.try_emplace(path + '\0' + MIME_type, route_table::npos);
+    if (inserted) {
+      auto file = load_file(path, MIME_type, next.config, this->start_time);
+      if (file.has_value()) {
+        it->second = next.files.size();
+        next.files.push_back(std::move(*file));
+      }
+    }
+    return it->second;
+  };
+
   // read each route into memory
   std::string line;
   while (std::getline(fp, line)) {
@@ -537,90 +1463,107 @@ void https_server::populate_router() {
       continue;
     }
 
-    // Parse the line: route path mime-type
+    // Parse the line: route path [mime-type], without a type it follows from the file extension
     std::istringstream iss(line);
-    std::string route;
-    file_info file;
+    std::string route, path, MIME_type;
 
-    if (!(iss >> route >> file.path >> file.MIME_type)) {
+    if (!(iss >> route >> path)) {
       log_info("ERROR: Invalid routing.conf format on line: %s", line.c_str());
       continue;
     }
+    iss >> MIME_type;
 
-    // load file content
-    std::fstream str(file.path, std::fstream::in);
-    if (!str) {
-      log_info("ERROR: Cannot open route file: %s - skipping route %s", file.path.c_str(), route.c_str());
-      continue;  // Skip this route but continue processing others
-    }
+    // "/prefix/* ./directory/" mounts every file below the directory under the prefix
+    if (route.length() >= 2 && route.compare(route.length() - 2, 2, "/*") == 0) {
+      std::string prefix = route.substr(0, route.length() - 1);
+      std::string directory = path.back() == '/' ? path : path + "/";
+      std::vector<std::string> files;
 
-    file.contents = std::string((std::istreambuf_iterator<char>(str)), std::istreambuf_iterator<char>());
+      if (!list_directory(directory, files)) {
+        log_info("ERROR: Cannot read mounted directory: %s - skipping route %s", directory.c_str(), route.c_str());
+        continue;
+      }
 
-    // insert route into table
-    this->routing.insert({ route, file });
-    log_info("ROUTER: Attached route %s to file path %s.", route.c_str(), file.path.c_str());
-  }
-}
+      size_t count = 0;
+      for (const std::string &file : files) {
+        uint32_t index = add_file(directory + file, MIME_type.empty() ? mime_type_for(file) : MIME_type);
+        if (index == route_table::npos) {
+          log_info("ERROR: Cannot open route file: %s%s - skipping it", directory.c_str(), file.c_str());
+          continue;
+        }
 
-// Implementation for populating server configuration from a file or defaults
-void https_server::populate_config() {
-  std::ifstream fp;
+        mounted.emplace_back(prefix + file, index);
+        count++;
 
-  // open config file
-  fp.open("./secure-serve.conf");
-  if (!fp) {
-    log_info("CONFIG: No config file found at ./secure-serve.conf");
-    return;
-  }
+        // a directory's index.html also answers for the directory itself
+        if (file_name(file).compare("index.html") == 0)
+          mounted.emplace_back(prefix + file.substr(0, file.length() - 10), index);
+      }
 
-  // read each config line
-  std::string line;
-  while (std::getline(fp, line)) {
-    // Skip empty lines and lines with only whitespace
-    if (line.empty() || line.find_first_not_of(" \t\r\n") == std::string::npos) {
+      next.mounts.push_back(directory);
+      log_info("ROUTER: Mounted %s on %s, %zu files.", directory.c_str(), route.c_str(), count);
       continue;
     }
 
-    // Skip comment lines (lines starting with #)
-    size_t first_char = line.find_first_not_of(" \t");
-    if (first_char != std::string::npos && line[first_char] == '#') {
-      continue;
+    uint32_t index = add_file(path, MIME_type.empty() ? mime_type_for(path) : MIME_type);
+    if (index == route_table::npos) {
+      log_info("ERROR: Cannot open route file: %s - skipping route %s", path.c_str(), route.c_str());
+      continue;  // Skip this route but continue processing others
     }
 
-    // Parse the line: key=value
-    std::istringstream iss(line);
-    std::string key, value_str;
-
-    if (!std::getline(iss, key, '=') || !std::getline(iss, value_str)) {
-      log_info("CONFIG: Invalid format on line: %s", line.c_str());
-      continue;
+    const file_info &file = next.files[index];
+    for (const auto &variant : file.variants) {
+      log_info("ROUTER: Precompressed %s with %s: %zu -> %zu bytes.", route.c_str(), variant.encoding.c_str(), file.contents.length(), variant.contents.length());
     }
 
-    // Trim whitespace from key and value
-    key.erase(0, key.find_first_not_of(" \t"));
-    key.erase(key.find_last_not_of(" \t") + 1);
-    value_str.erase(0, value_str.find_first_not_of(" \t"));
-    value_str.erase(value_str.find_last_not_of(" \t") + 1);
+    // insert route into table
+    listed.emplace_back(route, index);
+    log_info("ROUTER: Attached route %s to file path %s%s.", route.c_str(), file.path.c_str(), file.data->is_mapped() ? " (mapped)" : "");
+  }
 
-    // Try to parse as int, otherwise store as string
-    try {
-      int int_value = std::stoi(value_str);
-      this->config[key] = int_value;
-    } catch (const std::exception&) {
-      // Not an int, store as string
-      this->config[key] = value_str;
-    }
+  listed.insert(listed.end(), std::make_move_iterator(mounted.begin()), std::make_move_iterator(mounted.end()));
+  next.routes = route_table(std::move(listed));
+
+  // pre-build the response served for unknown routes
+  auto file_404 = next.get_endpoint("/404");
+  if (file_404.has_value()) {
+    next.not_found = file_404->get();
+  } else {
+    // Fallback if /404 route doesn't exist
+    next.not_found = {};
+    next.not_found.contents = "404 - Page Not Found";
+    next.not_found.MIME_type = "text/plain";
+  }
+  next.not_found.header = build_cached_header(404, "NOT FOUND", next.not_found);
+  for (auto &variant : next.not_found.variants) {
+    variant.header = build_cached_header(404, "NOT FOUND", next.not_found, &variant);
   }
 }
 
-// Helper to get config value with default
-https_server::config_value_t https_server::get_config_value(const std::string &key, const config_value_t &default_value) const {
-  auto it = this->config.find(key);
-  
-  if (it != this->config.end()) {
-    return it->second;
+// Populate the site's configuration from the config file, keys it leaves out keep their defaults.
+// Returns false if there is no config file, throws if it holds invalid values.
+bool https_server::populate_config(site &next) const {
+  std::ifstream fp;
+
+  // open config file
+  fp.open(CONFIG_PATH);
+  if (!fp) {
+    log_info("CONFIG: No config file found at %s", CONFIG_PATH);
+    return false;
   }
 
-  return default_value;
-}
+  std::vector<std::string> errors, warnings;
+  bool valid = parse_config(fp, next.config, errors, warnings);
 
+  for (const auto &warning : warnings) {
+    log_info("CONFIG: %s: %s", CONFIG_PATH, warning.c_str());
+  }
+  for (const auto &error : errors) {
+    log_info("CONFIG: ERROR: %s: %s", CONFIG_PATH, error.c_str());
+  }
+
+  if (!valid) {
+    throw std::runtime_error("Invalid configuration in " CONFIG_PATH);
+  }
+  return true;
+}
@@ -2,42 +2,94 @@
 #define __SERVE_HPP__
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include <unordered_map>
 #include <memory>
 #include <optional>
-#include <variant>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
 #include <openssl/ssl.h>
 #include <netinet/in.h> // struct sockaddr_in
 
 #include "util/pool.hpp"
+#include "util/output_queue.hpp"
+#include "util/asset.hpp"
+#include "util/rate_limiter.hpp"
+#include "util/metrics.hpp"
+#include "util/tls_session.hpp"
+#include "http/parser.hpp"
+#include "http/http2.hpp"
+#include "http/router.hpp"
+#include "config.hpp"
+
+class reactor;
 
 class https_server {
   public:
     struct file_info {
-      std::string contents, MIME_type, path;
+      // a precompressed copy of contents, with its own pre-serialized headers and entity tag
+      struct variant {
+        std::string encoding, contents, header, not_modified_header, etag;
+      };
+
+      std::shared_ptr<const asset> data; // heap copy or read-only mapping of the file
+      std::string_view contents; // view of data, or of a static fallback body
+      std::string MIME_type, path;
+      std::string header; // status line and headers serialized at load, minus Connection
+      std::string not_modified_header; // the same for a 304 answer
+      std::string etag; // strong validator, hash of contents
+      time_t last_modified = 0; // file mtime at load
+      std::string last_modified_str; // ... as an HTTP date
+      std::vector<variant> variants; // smallest first, only those smaller than contents
+    };
+
+    // Configuration and routes as loaded from disk. A reload builds a new site and publishes it
+    // whole, a published site is never modified, so requests finish on the one they started with.
+    struct site {
+      server_config config;
+      std::vector<file_info> files; // each loaded once, however many routes lead to it
+      route_table routes; // path -> index into files
+      std::vector<std::string> mounts; // directories mounted with "/prefix/*" routes
+      file_info not_found;
+
+      std::optional<std::reference_wrapper<const file_info>> get_endpoint(std::string_view path) const;
     };
 
     https_server();
     ~https_server();
 
-    std::optional<std::reference_wrapper<const file_info>> get_endpoint(const std::string &path) const;
-    size_t get_thread_count() const { return pool->get_thread_count(); }
+    std::shared_ptr<const site> get_site() const; // the current site, lock-free unless it just changed
+    void reload(); // load config and routes again, the current site stays if that fails
+    size_t get_thread_count() const { return pool ? pool->get_thread_count() : reactors.size(); }
+    size_t get_queue_depth() const { return pool ? pool->get_queue_depth() : 0; }
+    const std::string &get_unavailable_response() const { return unavailable_response; }
+    // Answer every complete request head buffered in request, returns whether to keep the connection.
+    // pinned keeps the site the queued responses point into alive until they are written.
+    bool serve_requests(std::string &request, http_parser &parser, output_queue &response, std::shared_ptr<const site> &pinned,
+                        int &served, struct in_addr client_addr) const;
+    // The same for an HTTP/2 connection, request holds received frames rather than request heads
+    bool serve_http2(std::string &request, http2_session &session, output_queue &response, std::shared_ptr<const site> &pinned,
+                     int &served, struct in_addr client_addr) const;
+    http_parser new_parser() const;
+    std::unique_ptr<http2_session> new_http2_session(SSL *ssl) const; // nullptr unless ALPN settled on h2
+    void count_handshake(SSL *ssl, std::chrono::steady_clock::time_point started) const;
 
     // Stats
     const time_t start_time;
-    mutable std::atomic<unsigned long> total_requests{0};
-    mutable std::atomic<unsigned long> valid_request_count{0};
-    mutable std::atomic<unsigned long> successful_request_count{0};
-
-    // ip logging and rate limiting table
-    // key: ip address (string), value: request count (unsigned long)
-    // value: pair<request count, last request time> atomic
-    using ip_log_table_t = std::unordered_map<std::string, std::pair<std::atomic<unsigned long>, std::atomic<time_t>>>;
-    // config file supports string and int types for variable values
-    using config_value_t = std::variant<std::string, int>;
-    config_value_t get_config_value(const std::string &key, const config_value_t &default_value) const;
+    mutable server_metrics metrics; // per-thread request, response and latency counters
+    mutable std::atomic<unsigned long> ktls_connections{0}; // connections sending through kernel TLS
+    mutable std::atomic<unsigned long> http2_connections{0}; // connections that negotiated h2
+    mutable std::atomic<unsigned long> shed_queue_full{0}; // refused at accept, the pool queue was full
+    mutable std::atomic<unsigned long> shed_queue_wait{0}; // waited longer than max_queue_wait_ms
+
+    // Config of the current site, read fields straight away: the reference is only good until this
+    // thread next asks for the config or site after a reload
+    const server_config &get_config() const { return cached_site()->config; }
   private:
     // Custom deleter for SSL_CTX
     struct SSL_CTX_Deleter {
@@ -46,24 +98,44 @@ class https_server {
       }
     };
 
-    int create_server_socket();
-    void main_loop();
+    int create_server_socket(bool reuse_port);
+    void main_loop(int listener);
+    void maintenance_loop();
+    void watch_loop();
 
     void create_SSL_context();
     void configure_SSL_context();
-    void populate_router();
-    void populate_config();
+    bool populate_config(site &next) const;
+    void populate_router(site &next) const;
+    void publish_site(std::shared_ptr<const site> next);
+    const std::shared_ptr<const site> &cached_site() const;
 
-    int socket_fd;
+    std::vector<int> listen_fds; // one per listener thread, SO_REUSEPORT when sharded
+    std::thread maintenance; // culls and snapshots the IP table in the background
+    std::mutex maintenance_mutex;
+    std::condition_variable maintenance_cv;
+    bool stopping = false;
+    std::thread watcher; // reloads the site on SIGHUP or, with watch_files, when its files change
 
+    std::unique_ptr<ticket_keys> tickets; // seals session tickets, outlives ssl_ctx which calls into it
     std::unique_ptr<SSL_CTX, SSL_CTX_Deleter> ssl_ctx;
-    std::unique_ptr<thread_pool> pool;
+    std::unique_ptr<thread_pool> pool; // io_engine=pool: one worker per connection
+    std::vector<std::unique_ptr<reactor>> reactors; // io_engine=reactor: per-core epoll loops
 
-    std::unordered_map<std::string, file_info> routing;
-    std::unordered_map<std::string, config_value_t> config;
-    ip_log_table_t ip_log_table;
+    mutable std::mutex site_mutex; // guards published_site, readers only take it after a reload
+    std::shared_ptr<const site> published_site;
+    std::atomic<unsigned long> site_generation{0}; // bumped on every publish
+    std::string unavailable_response; // prebuilt 503 for shed connections, empty to just close them
+    std::unique_ptr<rate_limiter> limiter; // per-client token buckets, also the IP log
+    std::string status_fields; // the start of the /status body, fields fixed at startup
+    mutable std::mutex status_mutex; // guards the status_cache_ms snapshot below
+    mutable char status_counters[1024]; // the rest of the /status body, as last formatted
+    mutable size_t status_counters_length = 0;
+    mutable std::chrono::steady_clock::time_point status_taken;
 
-    friend void handle_status_endpoint(const https_server *server, std::string &response, struct in_addr &client_addr);
+    friend void handle_status_endpoint(const https_server *server, output_queue &response, struct in_addr &client_addr, bool keep_alive);
+    friend size_t format_status_counters(const https_server *server, char *out, size_t size);
+    friend void handle_metrics_endpoint(const https_server *server, output_queue &response, struct in_addr &client_addr, bool keep_alive);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "asset.hpp"
+
+#include <mutex>
+#include <cstring>
+#include <csetjmp>
+#include <csignal>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+static thread_local sigjmp_buf *fault_jump = nullptr; // set while this thread copies from a mapping
+static std::once_flag fault_handler_installed;
+
+// A read past the end of a truncated mapped file lands here. Inside copy_mapped() the copy is
+// abandoned, anywhere else the default action is restored and the faulting access kills the process.
+static void on_bus_error(int) {
+  if (fault_jump)
+    siglongjmp(*fault_jump, 1);
+
+  signal(SIGBUS, SIG_DFL);
+}
+
+static void install_fault_handler(void) {
+  struct sigaction action = {};
+  action.sa_handler = on_bus_error;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGBUS, &action, nullptr);
+}
+
+
+// Load a file, mapping it when it is at least map_threshold bytes
+std::shared_ptr<const asset> asset::load(const std::string &path, size_t map_threshold) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+
+  std::shared_ptr<asset> loaded(new asset());
+  size_t length = file_stat.st_size;
+
+  if (length > 0 && length >= map_threshold) {
+    std::call_once(fault_handler_installed, install_fault_handler);
+    void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, length, MADV_SEQUENTIAL); // served front to back, read ahead aggressively
+      loaded->mapping = mapping;
+      loaded->mapping_length = length;
+      loaded->view = std::string_view(static_cast<const char *>(mapping), length);
+      loaded->fd = fd;
+      return loaded;
+    }
+    // fall back to a heap copy if the mapping failed
+  }
+
+  loaded->buffer.resize(length);
+  size_t total = 0;
+  while (total < length) {
+    ssize_t n = read(fd, loaded->buffer.data() + total, length - total);
+    if (n <= 0)
+      break;
+    total += n;
+  }
+
+  close(fd);
+  loaded->buffer.resize(total);
+  loaded->view = loaded->buffer;
+
+  return loaded;
+}
+
+bool asset::copy_mapped(char *out, const char *from, size_t length) {
+  sigjmp_buf jump;
+  if (sigsetjmp(jump, 1) != 0) {
+    fault_jump = nullptr;
+    return false; // the pages past the file's new end faulted
+  }
+
+  fault_jump = &jump;
+  memcpy(out, from, length);
+  fault_jump = nullptr;
+  return true;
+}
+
+// Release the mapping and its descriptor, heap copies free themselves
+asset::~asset() {
+  if (this->mapping) {
+    munmap(this->mapping, this->mapping_length);
+  }
+
+  if (this->fd >= 0) {
+    close(this->fd);
+  }
+}
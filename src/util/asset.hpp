@@ -0,0 +1,40 @@
+#ifndef __ASSET_HPP__
+#define __ASSET_HPP__
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+// Immutable bytes of one served file. Small files are copied onto the heap so they stay
+// resident, large ones are mapped read-only and paged in from the page cache on demand,
+// which keeps resident memory flat no matter how big the media is. The mapping follows the file:
+// truncating it (a cp over it, a > redirect, rsync --inplace) turns the pages past its new end into
+// SIGBUS, so mapped bytes are only ever read through copy_mapped().
+class asset {
+  public:
+    // Load a file, mapping it when it is at least map_threshold bytes. nullptr if unreadable.
+    static std::shared_ptr<const asset> load(const std::string &path, size_t map_threshold);
+    ~asset();
+
+    asset(const asset &) = delete;
+    asset &operator=(const asset &) = delete;
+
+    std::string_view data() const { return view; }
+    bool is_mapped() const { return mapping != nullptr; }
+    int get_fd() const { return fd; } // open descriptor of a mapped file, -1 for heap copies
+
+    // Copy length bytes starting at from, inside a mapping made by load(), into out. Returns false
+    // when the file was truncated under the mapping and they are gone: the fault is caught and
+    // only this copy fails, not the process.
+    static bool copy_mapped(char *out, const char *from, size_t length);
+  private:
+    asset() = default;
+
+    std::string buffer; // heap copy for small files
+    void *mapping = nullptr; // read-only mapping for large files
+    size_t mapping_length = 0;
+    int fd = -1; // kept open so the kernel can send straight from the page cache
+    std::string_view view;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "compress.hpp"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+
+// Content-Encoding names this build can produce
+std::vector<std::string> available_encodings(void) {
+  std::vector<std::string> encodings;
+
+#ifdef HAVE_BROTLI
+  encodings.push_back("br");
+#endif
+#ifdef HAVE_ZLIB
+  encodings.push_back("gzip");
+#endif
+
+  return encodings;
+}
+
+#ifdef HAVE_ZLIB
+// gzip framing around deflate, windowBits 15 + 16 selects the gzip header
+static std::optional<std::string> compress_gzip(std::string_view data) {
+  z_stream stream = {};
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    return std::nullopt;
+
+  std::string out(deflateBound(&stream, data.length()), '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  stream.avail_in = data.length();
+  stream.next_out = reinterpret_cast<Bytef *>(out.data());
+  stream.avail_out = out.length();
+
+  int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  if (result != Z_STREAM_END)
+    return std::nullopt;
+
+  return out;
+}
+#endif
+
+#ifdef HAVE_BROTLI
+static std::optional<std::string> compress_brotli(std::string_view data) {
+  size_t out_size = BrotliEncoderMaxCompressedSize(data.length());
+  if (out_size == 0)
+    return std::nullopt;
+
+  std::string out(out_size, '\0');
+  if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+                             data.length(), reinterpret_cast<const uint8_t *>(data.data()),
+                             &out_size, reinterpret_cast<uint8_t *>(out.data()))) {
+    return std::nullopt;
+  }
+
+  out.resize(out_size);
+  return out;
+}
+#endif
+
+// Compress data with the named encoding
+std::optional<std::string> compress(const std::string &encoding, std::string_view data) {
+#ifdef HAVE_ZLIB
+  if (encoding.compare("gzip") == 0)
+    return compress_gzip(data);
+#endif
+#ifdef HAVE_BROTLI
+  if (encoding.compare("br") == 0)
+    return compress_brotli(data);
+#endif
+
+  (void)data;
+  return std::nullopt;
+}
+
+// Whether a MIME type is worth compressing
+bool is_compressible(const std::string &MIME_type) {
+  if (MIME_type.compare(0, 5, "text/") == 0)
+    return true;
+
+  static const char *compressible[] = {
+    "application/json", "application/javascript", "application/xml",
+    "image/svg+xml", "image/x-icon"
+  };
+
+  for (const char *type : compressible) {
+    if (MIME_type.compare(type) == 0)
+      return true;
+  }
+
+  return false;
+}
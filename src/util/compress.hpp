@@ -0,0 +1,18 @@
+#ifndef __COMPRESS_HPP__
+#define __COMPRESS_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+
+// Content-Encoding names this build can produce (depends on the libraries found by CMake)
+std::vector<std::string> available_encodings(void);
+
+// Compress data at the highest level with the named encoding, nullopt if unsupported or failed
+std::optional<std::string> compress(const std::string &encoding, std::string_view data);
+
+// Whether a MIME type is worth compressing (text-like formats, not already compressed media)
+bool is_compressible(const std::string &MIME_type);
+
+#endif
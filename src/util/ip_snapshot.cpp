@@ -0,0 +1,107 @@
+#include "ip_snapshot.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+
+#define SNAPSHOT_MAGIC "SSIP"
+#define SNAPSHOT_VERSION 1
+#define RECORD_SIZE 41
+
+
+// Append an integer in little-endian byte order
+static void put_uint(std::string &out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out += static_cast<char>(value >> (8 * i));
+  }
+}
+
+// Read an integer in little-endian byte order
+static uint64_t get_uint(const char *in, int bytes) {
+  uint64_t value = 0;
+  for (int i = bytes - 1; i >= 0; --i) {
+    value = (value << 8) | static_cast<unsigned char>(in[i]);
+  }
+  return value;
+}
+
+// Write records to path through a temporary file and rename
+bool write_ip_snapshot(const std::vector<rate_limit_record> &records, const std::string &path) {
+  std::string buffer;
+  buffer.reserve(16 + records.size() * RECORD_SIZE);
+
+  buffer += SNAPSHOT_MAGIC;
+  put_uint(buffer, SNAPSHOT_VERSION, 4);
+  put_uint(buffer, records.size(), 8);
+
+  for (const rate_limit_record &record : records) {
+    put_uint(buffer, record.key.high, 8);
+    put_uint(buffer, record.key.low, 8);
+    put_uint(buffer, record.key.prefix, 1);
+    put_uint(buffer, record.requests, 8);
+    put_uint(buffer, record.rejected, 8);
+    put_uint(buffer, static_cast<uint64_t>(record.last_seen), 8);
+  }
+
+  std::string temp_path = path + ".tmp";
+  std::ofstream file(temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    return false;
+
+  file.write(buffer.data(), buffer.length());
+  file.close();
+  if (!file)
+    return false;
+
+  return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+// Read a snapshot back
+std::optional<std::vector<rate_limit_record>> read_ip_snapshot(const std::string &path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file.is_open())
+    return std::nullopt;
+
+  std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (contents.length() < 16 || contents.compare(0, 4, SNAPSHOT_MAGIC) != 0 ||
+      get_uint(contents.data() + 4, 4) != SNAPSHOT_VERSION) {
+    return std::nullopt;
+  }
+
+  uint64_t count = get_uint(contents.data() + 8, 8);
+  if ((contents.length() - 16) / RECORD_SIZE < count)
+    return std::nullopt;
+
+  std::vector<rate_limit_record> records(count);
+  const char *in = contents.data() + 16;
+  for (rate_limit_record &record : records) {
+    record.key.high = get_uint(in, 8);
+    record.key.low = get_uint(in + 8, 8);
+    record.key.prefix = get_uint(in + 16, 1);
+    record.requests = get_uint(in + 17, 8);
+    record.rejected = get_uint(in + 25, 8);
+    record.last_seen = static_cast<time_t>(get_uint(in + 33, 8));
+    in += RECORD_SIZE;
+  }
+
+  return records;
+}
+
+// Write records as CSV, one line per client
+void write_ip_csv(const std::vector<rate_limit_record> &records, std::ostream &out) {
+  out << "IP Address,Request Count,Rejected Count,Last Request Timestamp,Last Request Time\n";
+
+  for (const rate_limit_record &record : records) {
+    time_t timestamp = record.last_seen;
+    struct tm local_tm;
+    char time_buffer[32];
+    std::strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", localtime_r(&timestamp, &local_tm));
+
+    out << record.key.to_string() << ","
+        << record.requests << ","
+        << record.rejected << ","
+        << timestamp << ","
+        << time_buffer << "\n";
+  }
+}
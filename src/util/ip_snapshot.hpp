@@ -0,0 +1,24 @@
+#ifndef __IP_SNAPSHOT_HPP__
+#define __IP_SNAPSHOT_HPP__
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <ostream>
+
+#include "rate_limiter.hpp"
+
+// Compact binary dump of the rate limiter's client table. The file starts with the magic "SSIP",
+// a format version and the record count, followed by fixed 41 byte little-endian records:
+// address high and low halves, prefix length, requests, rejected and last seen time.
+
+// Write records to path through a temporary file and rename, so readers never see half a snapshot
+bool write_ip_snapshot(const std::vector<rate_limit_record> &records, const std::string &path);
+
+// Read a snapshot back, nullopt if the file is missing, truncated or not a snapshot
+std::optional<std::vector<rate_limit_record>> read_ip_snapshot(const std::string &path);
+
+// Write records as CSV, one line per client
+void write_ip_csv(const std::vector<rate_limit_record> &records, std::ostream &out);
+
+#endif
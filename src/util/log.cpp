@@ -1,74 +1,272 @@
+#include "log.hpp"
+
 #include <iostream>
-#include <fstream>
-#include <iomanip>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
 
 #include <cstdarg>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #define LINE_BUF_SIZE 256
+#define LOG_RING_SIZE 4096 // lines buffered between the workers and the writer, power of two
+#define LOG_BATCH_SIZE 65536 // bytes gathered into one write() call
+#define LOG_FILE_PATH "../logs/server.log"
+#define EXTERNAL_CHECK_SECONDS 10 // how often files written by other processes are checked for size
 
-static std::fstream file("../logs/server.log", std::fstream::app);
-static std::mutex log_mutex;
+// One line waiting in the ring. sequence tells producers and the writer whose turn the slot is
+// (the bounded multi-producer queue by Dmitry Vyukov), so pushing never takes a lock.
+struct log_slot {
+  std::atomic<size_t> sequence;
+  size_t length;
+  char line[LINE_BUF_SIZE];
+};
 
+static log_slot ring[LOG_RING_SIZE];
+static std::atomic<size_t> enqueue_pos{0};
+static size_t dequeue_pos = 0; // only touched by the writer thread
 
-// Close the open file descriptor
-void close_log_file(void) {
-  file.close();
+static std::atomic<unsigned long> dropped{0};
+static std::atomic<int> flush_interval_ms{100};
+static std::atomic<bool> running{false};
+
+static int file_fd = -1;
+static size_t file_size = 0; // bytes in the current segment, tracked so rotation never needs a stat
+static std::atomic<size_t> max_file_size{52428800};
+static std::atomic<int> retained_segments{5};
+static std::mutex log_mutex; // held while writing, and while the list of rotated files changes
+static std::vector<std::string> external_logs; // appended to by other processes, checked periodically
+static std::thread writer;
+static std::once_flag writer_started;
+
+static void writer_loop(void);
+
+// Stops the writer when the process exits without calling close_log_file()
+static struct writer_guard {
+  ~writer_guard() { close_log_file(); }
+} guard;
+
+
+// Open the current segment of the log file and pick up its size
+static void open_log_file(void) {
+  file_fd = open(LOG_FILE_PATH, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+  struct stat file_stat;
+  file_size = (file_fd >= 0 && fstat(file_fd, &file_stat) == 0) ? file_stat.st_size : 0;
 }
 
+// Shift path.1 .. path.(n-1) up by one and move path to path.1, the oldest segment falls off
+static void roll_segments(const std::string &path) {
+  int segments = retained_segments.load();
 
-// Log information to both the console and a log file
-void log_info(const char *fmt, ...) {
-  va_list args;
-  va_start(args, fmt);
+  std::remove((path + "." + std::to_string(segments)).c_str());
+  for (int i = segments - 1; i >= 1; --i) {
+    std::rename((path + "." + std::to_string(i)).c_str(), (path + "." + std::to_string(i + 1)).c_str());
+  }
 
-  const size_t length = std::size("[mm/dd/yy hh:mm:ss]: "); // get length of time string
-  char line_buf[LINE_BUF_SIZE];
-  auto t = std::time(nullptr);
+  if (segments > 0) {
+    std::rename(path.c_str(), (path + ".1").c_str());
+  } else {
+    std::remove(path.c_str());
+  }
+}
 
-  std::strftime(line_buf, length, "[%D %T]: ", std::localtime(&t)); // put date and time into string
-  vsnprintf(line_buf + (length - 1), 256 - (length - 1), fmt, args); // add the message
+// Roll the server log and start a fresh segment
+static void rotate_log_file(void) {
+  close(file_fd);
+  roll_segments(LOG_FILE_PATH);
+  open_log_file();
+}
 
-  {
-    std::lock_guard<std::mutex> lock(log_mutex);
-    std::cout << line_buf << std::endl; // print message
-    file << line_buf << std::endl; // add message to log file
-    file.flush(); // ensure immediate write
+// Roll files written by other processes once they pass the size limit. They reopen the file on
+// every append, so renaming is enough.
+static void rotate_external_logs(void) {
+  std::lock_guard<std::mutex> lock(log_mutex);
+
+  for (const std::string &path : external_logs) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) >= max_file_size.load()) {
+      roll_segments(path);
+    }
   }
+}
 
-  va_end(args);
+// Open the log file and start the writer thread, on the first log line
+static void start_writer(void) {
+  for (size_t i = 0; i < LOG_RING_SIZE; ++i) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  open_log_file();
+  running = true;
+  writer = std::thread(writer_loop);
+}
+
+// Claim a free slot, nullptr when the ring is full
+static log_slot *claim_slot(size_t &pos) {
+  pos = enqueue_pos.load(std::memory_order_relaxed);
+
+  for (;;) {
+    log_slot &slot = ring[pos & (LOG_RING_SIZE - 1)];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        return &slot;
+    } else if (diff < 0) {
+      return nullptr; // the writer has not caught up yet
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Move every published line into batch, stopping early once the batch is full
+static void drain_ring(std::string &batch) {
+  while (batch.length() + LINE_BUF_SIZE + 1 < LOG_BATCH_SIZE) {
+    log_slot &slot = ring[dequeue_pos & (LOG_RING_SIZE - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1)
+      return; // nothing published yet
+
+    batch.append(slot.line, slot.length);
+    batch += '\n';
+
+    slot.sequence.store(dequeue_pos + LOG_RING_SIZE, std::memory_order_release);
+    dequeue_pos++;
+  }
+}
+
+// Write a whole buffer to a descriptor
+static void write_all(int fd, const std::string &data) {
+  size_t total = 0;
+  while (fd >= 0 && total < data.length()) {
+    ssize_t n = write(fd, data.data() + total, data.length() - total);
+    if (n <= 0)
+      return;
+    total += n;
+  }
+}
+
+// Main function of the writer thread, gathers lines into batches and writes them out. Sleeps for
+// the flush interval whenever the ring runs dry, so an idle server costs nothing.
+static void writer_loop(void) {
+  std::string batch;
+  batch.reserve(LOG_BATCH_SIZE);
+  unsigned long reported_drops = 0;
+  auto next_external_check = std::chrono::steady_clock::now();
+
+  for (;;) {
+    bool stopping = !running.load();
+
+    batch.clear();
+    drain_ring(batch);
+
+    unsigned long drops = dropped.load();
+    if (drops != reported_drops) {
+      batch += "LOG: " + std::to_string(drops - reported_drops) + " message(s) dropped, log buffer full\n";
+      reported_drops = drops;
+    }
+
+    if (!batch.empty()) {
+      std::lock_guard<std::mutex> lock(log_mutex);
+      write_all(STDOUT_FILENO, batch);
+      write_all(file_fd, batch);
+
+      file_size += batch.length();
+      if (file_size >= max_file_size.load()) {
+        rotate_log_file();
+      }
+    } else if (stopping) {
+      return; // everything queued before shutdown has been written
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(flush_interval_ms.load()));
+    }
+
+    if (std::chrono::steady_clock::now() >= next_external_check) {
+      rotate_external_logs();
+      next_external_check = std::chrono::steady_clock::now() + std::chrono::seconds(EXTERNAL_CHECK_SECONDS);
+    }
+  }
 }
 
-void cull_log_file(int max_size_bytes, std::string file_path) {
+// Set how long the writer waits between checks when there is nothing to write, and when to rotate
+void configure_logging(int interval_ms, size_t max_size, int segments) {
+  flush_interval_ms = interval_ms > 0 ? interval_ms : 1;
+  max_file_size = max_size > 0 ? max_size : SIZE_MAX;
+  retained_segments = segments > 0 ? segments : 0;
+}
+
+// Have the writer also rotate a log file that another process appends to
+void add_rotated_log(const std::string &path) {
   std::lock_guard<std::mutex> lock(log_mutex);
+  external_logs.push_back(path);
+}
 
-  std::fstream file(file_path, std::fstream::in | std::fstream::out | std::fstream::app);
-  file.seekg(0, std::ios::end);
-  std::streampos file_size = file.tellg();
+// Lines lost because the ring was full
+unsigned long get_dropped_log_count(void) {
+  return dropped.load();
+}
 
-  if (file_size <= max_size_bytes) {
-    return; // No need to cull
+// Stop the writer after it has written everything queued, then close the file
+void close_log_file(void) {
+  if (!running.exchange(false))
+    return;
+
+  writer.join();
+  close(file_fd);
+  file_fd = -1;
+}
+
+
+// Log information to both the console and a log file. The line is formatted straight into a ring
+// slot and written by the background thread, so callers never wait on a lock or on I/O.
+void log_info(const char *fmt, ...) {
+  std::call_once(writer_started, start_writer);
+
+  // formatting the date is the expensive part, redo it at most once a second per thread
+  const size_t length = std::size("[mm/dd/yy hh:mm:ss]: "); // get length of time string
+  thread_local time_t last_time = 0;
+  thread_local char time_buf[32];
+  auto t = std::time(nullptr);
+  if (t != last_time) {
+    struct tm local_tm;
+    std::strftime(time_buf, length, "[%D %T]: ", localtime_r(&t, &local_tm)); // put date and time into string
+    last_time = t;
   }
 
-  // Read the entire log file into memory
-  file.seekg(0, std::ios::beg);
-  std::string log_contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  char line_buf[LINE_BUF_SIZE];
+  char *line = line_buf;
+  size_t pos = 0;
 
-  // Find the position to start retaining logs
-  size_t start_pos = log_contents.size() - max_size_bytes;
-  size_t new_line_pos = log_contents.find('\n', start_pos);
+  // after shutdown there is no writer left, fall back to printing directly
+  log_slot *slot = running.load() ? claim_slot(pos) : nullptr;
+  if (slot)
+    line = slot->line;
 
-  if (new_line_pos != std::string::npos) {
-    // Retain logs from the next line
-    log_contents = log_contents.substr(new_line_pos + 1);
+  va_list args;
+  va_start(args, fmt);
+  memcpy(line, time_buf, length - 1);
+  int written = vsnprintf(line + (length - 1), LINE_BUF_SIZE - (length - 1), fmt, args); // add the message
+  va_end(args);
+
+  size_t line_length = std::min<size_t>(length - 1 + std::max(written, 0), LINE_BUF_SIZE - 1);
+
+  if (slot) {
+    slot->length = line_length;
+    slot->sequence.store(pos + 1, std::memory_order_release); // publish to the writer
+  } else if (running.load()) {
+    dropped++;
   } else {
-    // If no newline found, retain the last max_size_bytes
-    log_contents = log_contents.substr(start_pos);
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << std::string_view(line, line_length) << std::endl; // print message
   }
-
-  // Rewrite the log file with the retained logs
-  file.close();
-  file.open("../logs/server.log", std::fstream::out | std::fstream::trunc);
-  file << log_contents;
-  file.flush();
-}
\ No newline at end of file
+}
@@ -6,6 +6,11 @@
 void close_log_file(void);
 void log_info(const char *fmt, ...);
 
-void cull_log_file(int max_size, std::string file = std::string("../logs/server.log"));
+// Lines are written by a background thread, interval_ms is how long it idles when nothing is queued.
+// Once the log reaches max_size bytes it is renamed to server.log.1 (older segments shift up) and
+// at most segments rolled files are kept.
+void configure_logging(int interval_ms, size_t max_size, int segments);
+void add_rotated_log(const std::string &path); // also rotate a file other processes append to
+unsigned long get_dropped_log_count(void); // lines lost because the log buffer was full
 
-#endif
\ No newline at end of file
+#endif
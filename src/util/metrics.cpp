@@ -0,0 +1,265 @@
+#include "metrics.hpp"
+
+#include <map>
+#include <algorithm>
+#include <cstdio>
+
+
+// Add one to a counter only this thread writes, a plain load and store instead of a locked add
+static inline void bump(std::atomic<uint64_t> &counter, uint64_t amount = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Quote a label value: backslash, double quote and newline are escaped
+static void append_label(std::string &out, const char *name, std::string_view value) {
+  out += name;
+  out += "=\"";
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+static void append_header(std::string &out, const char *prefix, const char *name, const char *type, const char *help) {
+  out += "# HELP ";
+  out += prefix;
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += prefix;
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+void append_metric(std::string &out, const char *prefix, const char *name, const char *type, const char *help, double value) {
+  char number[64];
+  append_header(out, prefix, name, type, help);
+  snprintf(number, sizeof(number), " %.17g\n", value);
+  out += prefix;
+  out += name;
+  out += number;
+}
+
+std::atomic<uint64_t> server_metrics::next_id{1};
+
+// This thread's shard, created on first use. The thread caches its shard of the instance it last
+// counted into; after counting into another instance it finds its existing shard again.
+server_metrics::shard &server_metrics::local() {
+  struct cache {
+    uint64_t owner = 0;
+    shard *current = nullptr;
+  };
+  thread_local cache cached;
+
+  if (cached.owner != this->id) {
+    std::lock_guard<std::mutex> lock(this->shards_mutex);
+    shard *&own = this->owners[std::this_thread::get_id()];
+    if (!own) {
+      this->shards.push_back(std::make_unique<shard>());
+      own = this->shards.back().get();
+    }
+    cached.current = own;
+    cached.owner = this->id;
+  }
+
+  return *cached.current;
+}
+
+void server_metrics::count_connection() {
+  bump(this->local().connections);
+}
+
+void server_metrics::count_response(int status) {
+  if (status >= 100 && status <= 599)
+    bump(this->local().statuses[status - 100]);
+}
+
+void server_metrics::count_route(std::string_view route) {
+  shard &own = this->local();
+
+  // only this thread inserts, so finding without the lock cannot race with a change
+  auto found = own.routes.find(route);
+  if (found == own.routes.end()) {
+    std::lock_guard<std::mutex> lock(own.lock);
+    std::string_view key = own.route_names.emplace_back(route);
+    found = own.routes.try_emplace(key).first;
+  }
+
+  bump(found->second);
+}
+
+void server_metrics::count_handshake(const char *version, const char *cipher, bool resumed) {
+  shard &own = this->local();
+  if (resumed)
+    bump(own.resumed_handshakes);
+
+  auto key = std::make_pair(version, cipher);
+
+  auto found = own.handshakes.find(key);
+  if (found == own.handshakes.end()) {
+    std::lock_guard<std::mutex> lock(own.lock);
+    found = own.handshakes.try_emplace(key).first;
+  }
+
+  bump(found->second);
+}
+
+// Record a duration in the first bucket whose bound is not below it
+void server_metrics::observe(timer which, std::chrono::steady_clock::duration elapsed) {
+  uint64_t ns = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  uint64_t us = (ns + 999) / 1000;
+  size_t bucket = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1); // ceil(log2(us))
+
+  histogram &target = this->local().timers[static_cast<size_t>(which)];
+  bump(target.buckets[std::min(bucket, BUCKET_COUNT)]);
+  bump(target.sum_ns, ns);
+}
+
+uint64_t server_metrics::connections() const {
+  std::lock_guard<std::mutex> lock(this->shards_mutex);
+  uint64_t total = 0;
+  for (const auto &each : this->shards) {
+    total += each->connections.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+uint64_t server_metrics::responses(int first_status, int last_status) const {
+  std::lock_guard<std::mutex> lock(this->shards_mutex);
+  uint64_t total = 0;
+  for (const auto &each : this->shards) {
+    for (int status = std::max(first_status, 100); status <= std::min(last_status, 599); ++status) {
+      total += each->statuses[status - 100].load(std::memory_order_relaxed);
+    }
+  }
+  return total;
+}
+
+uint64_t server_metrics::handshakes(bool resumed_only) const {
+  std::lock_guard<std::mutex> lock(this->shards_mutex);
+  uint64_t total = 0;
+  for (const auto &each : this->shards) {
+    if (resumed_only) {
+      total += each->resumed_handshakes.load(std::memory_order_relaxed);
+      continue;
+    }
+
+    std::lock_guard<std::mutex> labels(each->lock);
+    for (const auto &[key, count] : each->handshakes) {
+      total += count.load(std::memory_order_relaxed);
+    }
+  }
+  return total;
+}
+
+void server_metrics::render(std::string &out, const char *prefix) const {
+  static const char *timer_names[] = { "handshake_duration_seconds", "queue_wait_seconds", "request_duration_seconds" };
+  static const char *timer_help[] = {
+    "TLS handshake time, from the first SSL_accept to completion.",
+    "Time accepted connections waited before a thread picked them up.",
+    "Time to build the response to one request head, excluding the write."
+  };
+
+  // add the shards up first, so the shards lock is not held while formatting
+  uint64_t connections = 0, resumed = 0;
+  uint64_t statuses[500] = {};
+  uint64_t buckets[static_cast<size_t>(timer::count)][BUCKET_COUNT + 1] = {};
+  uint64_t sums[static_cast<size_t>(timer::count)] = {};
+  std::map<std::string, uint64_t> routes;
+  std::map<std::pair<std::string, std::string>, uint64_t> handshakes;
+  { // after the mutex goes out of scope it is released
+    std::lock_guard<std::mutex> lock(this->shards_mutex);
+    for (const auto &each : this->shards) {
+      connections += each->connections.load(std::memory_order_relaxed);
+      resumed += each->resumed_handshakes.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < 500; ++i) {
+        statuses[i] += each->statuses[i].load(std::memory_order_relaxed);
+      }
+      for (size_t t = 0; t < static_cast<size_t>(timer::count); ++t) {
+        for (size_t b = 0; b <= BUCKET_COUNT; ++b) {
+          buckets[t][b] += each->timers[t].buckets[b].load(std::memory_order_relaxed);
+        }
+        sums[t] += each->timers[t].sum_ns.load(std::memory_order_relaxed);
+      }
+
+      std::lock_guard<std::mutex> labels(each->lock);
+      for (const auto &[route, count] : each->routes) {
+        routes[std::string(route)] += count.load(std::memory_order_relaxed);
+      }
+      for (const auto &[key, count] : each->handshakes) {
+        handshakes[{ key.first ? key.first : "unknown", key.second ? key.second : "unknown" }] += count.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  char number[64];
+
+  append_metric(out, prefix, "connections_total", "counter", "Connections accepted, including those later refused.", connections);
+
+  append_header(out, prefix, "responses_total", "counter", "Responses sent, by status code.");
+  for (int i = 0; i < 500; ++i) {
+    if (statuses[i] == 0)
+      continue;
+    snprintf(number, sizeof(number), "responses_total{code=\"%d\"} %lu\n", i + 100, static_cast<unsigned long>(statuses[i]));
+    out += prefix;
+    out += number;
+  }
+
+  append_header(out, prefix, "route_requests_total", "counter", "Requests answered from the route table, by route.");
+  for (const auto &[route, count] : routes) {
+    out += prefix;
+    out += "route_requests_total{";
+    append_label(out, "route", route);
+    snprintf(number, sizeof(number), "} %lu\n", static_cast<unsigned long>(count));
+    out += number;
+  }
+
+  append_header(out, prefix, "tls_handshakes_total", "counter", "Completed TLS handshakes, by protocol version and cipher.");
+  for (const auto &[key, count] : handshakes) {
+    out += prefix;
+    out += "tls_handshakes_total{";
+    append_label(out, "version", key.first);
+    out += ',';
+    append_label(out, "cipher", key.second);
+    snprintf(number, sizeof(number), "} %lu\n", static_cast<unsigned long>(count));
+    out += number;
+  }
+
+  append_metric(out, prefix, "tls_resumed_handshakes_total", "counter", "Completed TLS handshakes that resumed an earlier session.", resumed);
+
+  for (size_t t = 0; t < static_cast<size_t>(timer::count); ++t) {
+    append_header(out, prefix, timer_names[t], "histogram", timer_help[t]);
+
+    // Prometheus buckets are cumulative
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b <= BUCKET_COUNT; ++b) {
+      cumulative += buckets[t][b];
+      out += prefix;
+      out += timer_names[t];
+      if (b < BUCKET_COUNT)
+        snprintf(number, sizeof(number), "_bucket{le=\"%.9g\"} %lu\n", static_cast<double>(1ull << b) / 1e6, static_cast<unsigned long>(cumulative));
+      else
+        snprintf(number, sizeof(number), "_bucket{le=\"+Inf\"} %lu\n", static_cast<unsigned long>(cumulative));
+      out += number;
+    }
+
+    out += prefix;
+    out += timer_names[t];
+    snprintf(number, sizeof(number), "_sum %.9g\n", static_cast<double>(sums[t]) / 1e9);
+    out += number;
+    out += prefix;
+    out += timer_names[t];
+    snprintf(number, sizeof(number), "_count %lu\n", static_cast<unsigned long>(cumulative));
+    out += number;
+  }
+}
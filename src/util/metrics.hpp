@@ -0,0 +1,77 @@
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+
+// Request, response and TLS counters plus latency histograms. Every thread counts into its own
+// shard, so recording never touches a cache line another core writes; reads add the shards up.
+// Counters are single writer, a shard's lock only guards its label maps against a concurrent read.
+class server_metrics {
+  public:
+    enum class timer { handshake, queue_wait, request, count };
+
+    // Histogram buckets are powers of two microseconds, 1us up to 2^(BUCKET_COUNT - 1)us (~16.8s)
+    static constexpr size_t BUCKET_COUNT = 25;
+
+    void count_connection(); // accepted, before rate limiting
+    void count_response(int status);
+    void count_route(std::string_view route); // a request answered from the route table
+    void count_handshake(const char *version, const char *cipher, bool resumed); // static strings from OpenSSL
+    void observe(timer which, std::chrono::steady_clock::duration elapsed);
+
+    // Totals across every thread
+    uint64_t connections() const;
+    uint64_t responses(int first_status, int last_status) const; // inclusive range
+    uint64_t handshakes(bool resumed_only) const;
+
+    // Append every metric in Prometheus text format, names prefixed with prefix
+    void render(std::string &out, const char *prefix) const;
+  private:
+    struct histogram {
+      std::atomic<uint64_t> buckets[BUCKET_COUNT + 1] = {}; // the last one is +Inf
+      std::atomic<uint64_t> sum_ns{0};
+    };
+
+    struct pointer_pair_hash {
+      size_t operator()(const std::pair<const char *, const char *> &key) const {
+        return std::hash<const void *>()(key.first) * 31 + std::hash<const void *>()(key.second);
+      }
+    };
+
+    struct alignas(64) shard {
+      std::atomic<uint64_t> connections{0};
+      std::atomic<uint64_t> resumed_handshakes{0};
+      std::atomic<uint64_t> statuses[500] = {}; // 100 to 599
+      histogram timers[static_cast<size_t>(timer::count)];
+
+      mutable std::mutex lock; // held by the owner only while adding a label, and by readers
+      std::deque<std::string> route_names; // stable storage the route keys point into
+      std::unordered_map<std::string_view, std::atomic<uint64_t>> routes;
+      std::unordered_map<std::pair<const char *, const char *>, std::atomic<uint64_t>, pointer_pair_hash> handshakes; // by version and cipher
+    };
+
+    shard &local();
+
+    static std::atomic<uint64_t> next_id;
+    const uint64_t id = next_id.fetch_add(1); // names the instance in per-thread caches, never reused unlike its address
+
+    mutable std::mutex shards_mutex; // guards shards and owners, taken when a thread switches instances and by readers
+    std::vector<std::unique_ptr<shard>> shards;
+    std::unordered_map<std::thread::id, shard *> owners; // each thread's shard, so a thread never gets two
+};
+
+// Append one unlabelled sample with its HELP and TYPE lines, for values kept outside server_metrics
+void append_metric(std::string &out, const char *prefix, const char *name, const char *type, const char *help, double value);
+
+#endif
@@ -0,0 +1,134 @@
+#include "output_queue.hpp"
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include "asset.hpp"
+
+
+// Copy text onto the end of the queue, merging with the previous owned segment when possible
+void output_queue::append(std::string_view text) {
+  if (text.empty())
+    return;
+
+  if (!this->empty() && this->segments.back().ref == nullptr &&
+      this->segments.back().offset + this->segments.back().length == this->owned.length()) {
+    this->segments.back().length += text.length();
+  } else {
+    this->segments.push_back({ nullptr, this->owned.length(), text.length(), -1, 0 });
+  }
+
+  this->owned.append(text);
+}
+
+// Reference shared bytes without copying them
+void output_queue::append_ref(std::string_view shared) {
+  if (shared.empty())
+    return;
+
+  this->segments.push_back({ shared.data(), 0, shared.length(), -1, 0 });
+}
+
+// Reference mapped file bytes, remembering where they live so they can be sent from the file
+void output_queue::append_file(std::string_view mapped, int fd, off_t file_offset) {
+  if (mapped.empty())
+    return;
+
+  this->segments.push_back({ mapped.data(), 0, mapped.length(), fd, file_offset });
+}
+
+// Total bytes still queued
+size_t output_queue::size() const {
+  size_t total = 0;
+  for (size_t i = this->next; i < this->segments.size(); ++i) {
+    total += this->segments[i].length;
+  }
+
+  return total;
+}
+
+// The next contiguous run of bytes to hand to the socket
+std::string_view output_queue::front() const {
+  if (this->empty())
+    return std::string_view();
+
+  const segment &seg = this->segments[this->next];
+  size_t length = std::min(seg.length, max_chunk);
+  if (seg.ref == nullptr)
+    return std::string_view(this->owned.data() + seg.offset, length);
+  if (seg.fd < 0)
+    return std::string_view(seg.ref + seg.offset, length);
+
+  // mapped file bytes: serve from the staged copy while it covers them, a write that was only
+  // partly taken or has to be retried gets the same buffer back
+  const char *from = seg.ref + seg.offset;
+  if (this->staged_from && from >= this->staged_from && from < this->staged_from + this->staged.length())
+    return std::string_view(this->staged).substr(from - this->staged_from, length);
+
+  this->staged.resize(length);
+  if (this->file_truncated || !asset::copy_mapped(this->staged.data(), from, length)) {
+    this->file_truncated = true;
+    this->staged_from = nullptr;
+    return std::string_view();
+  }
+
+  this->staged_from = from;
+  return this->staged;
+}
+
+// Drop written bytes from the front, resetting the buffers once everything has been sent
+void output_queue::consume(size_t bytes) {
+  while (bytes > 0 && !this->empty()) {
+    segment &seg = this->segments[this->next];
+    size_t used = std::min(bytes, seg.length);
+
+    seg.offset += used;
+    seg.length -= used;
+    bytes -= used;
+
+    if (seg.length == 0)
+      this->next++;
+  }
+
+  if (this->empty())
+    this->clear();
+}
+
+// Forget everything queued, keeping the allocated capacity for the next response
+void output_queue::clear() {
+  this->owned.clear();
+  this->segments.clear();
+  this->next = 0;
+  this->staged_from = nullptr; // the mapping may go away with the response
+  this->file_truncated = false;
+}
+
+// Write the front chunk, from the file when kernel TLS can encrypt straight from the page cache
+int output_queue::write_to(SSL *ssl, bool use_sendfile) {
+  const segment &seg = this->segments[this->next];
+  int written;
+
+  if (use_sendfile && seg.fd >= 0) {
+    // the kernel reads the file itself and cannot fault, but a file shorter than the response announced ends it
+    size_t length = std::min(seg.length, max_chunk);
+    struct stat file_stat;
+    if (fstat(seg.fd, &file_stat) == 0 && file_stat.st_size < static_cast<off_t>(seg.file_base + seg.offset + length)) {
+      this->file_truncated = true;
+      return -1;
+    }
+
+    ossl_ssize_t sent = SSL_sendfile(ssl, seg.fd, seg.file_base + seg.offset, length, 0);
+    written = sent > 0 ? static_cast<int>(sent) : -1;
+  } else {
+    std::string_view chunk = this->front();
+    if (chunk.empty())
+      return -1; // truncated()
+    written = SSL_write(ssl, chunk.data(), chunk.length());
+  }
+
+  if (written > 0)
+    this->consume(written);
+
+  return written;
+}
@@ -0,0 +1,62 @@
+#ifndef __OUTPUT_QUEUE_HPP__
+#define __OUTPUT_QUEUE_HPP__
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+#include <openssl/ssl.h>
+
+// Bytes waiting to be written to one connection. Generated text (status lines, headers, small
+// dynamic bodies) is copied into an owned buffer, while cached bodies are only referenced so
+// serving a file never copies it. Bytes of a mapped file are the exception: each chunk is copied
+// out of the mapping just before it is written, so a file truncated meanwhile fails that copy
+// instead of faulting inside OpenSSL. The queue is reused across requests, after warm up appending
+// does not allocate.
+class output_queue {
+  public:
+    void append(std::string_view text); // copied into the queue
+    void append_ref(std::string_view shared); // referenced, must outlive the queue entry
+    void append_file(std::string_view mapped, int fd, off_t file_offset); // referenced, also sendable from fd
+
+    bool empty() const { return next == segments.size(); }
+    size_t size() const;
+
+    // Largest run handed to one write, big bodies are streamed in pieces of this size so a
+    // single write never has to encrypt or page in the whole file
+    static constexpr size_t max_chunk = 65536;
+
+    std::string_view front() const; // next contiguous bytes to write, at most max_chunk, empty once truncated()
+    void consume(size_t bytes); // drop bytes from the front after a write
+    void clear();
+
+    // Write the front chunk with SSL_write, or SSL_sendfile when the bytes come from a file and
+    // the connection has kernel TLS for sending. Consumes what was written and returns the
+    // OpenSSL result, <= 0 means SSL_get_error() says why unless truncated().
+    int write_to(SSL *ssl, bool use_sendfile);
+
+    // A queued file body shrank on disk before it was sent. What is left can never be sent and
+    // the response already announced its length, so the connection has to be closed.
+    bool truncated() const { return file_truncated; }
+  private:
+    // ref == nullptr means the bytes live in owned at offset, fd >= 0 marks bytes that also
+    // live in a file at file_base + offset
+    struct segment {
+      const char *ref;
+      size_t offset, length;
+      int fd;
+      off_t file_base;
+    };
+
+    std::string owned;
+    std::vector<segment> segments;
+    size_t next = 0;
+
+    // the last chunk copied out of a mapped file, staged_from is where it starts in the mapping
+    mutable std::string staged;
+    mutable const char *staged_from = nullptr;
+    mutable bool file_truncated = false;
+};
+
+#endif
@@ -1,80 +1,226 @@
 #include "pool.hpp"
 
 #include <thread>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sched.h>
 
 #include "log.hpp"
 
 
+#define SPIN_LIMIT 2048 // empty polls before an idle worker parks
+
+// the pool and deque index of the worker running on this thread, if any
+static thread_local const thread_pool *current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+// Tell the CPU we are busy-waiting (saves power, frees the core for a hyperthread sibling)
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
 // Creates the thread pool, populates the pool with specified or max threads
-thread_pool::thread_pool(int requested_threads) {
+thread_pool::thread_pool(int requested_threads, size_t max_queue_depth) : max_depth(max_queue_depth) {
   // Use hardware concurrency if 0 or invalid value provided
   uint32_t num_threads = (requested_threads > 0)
     ? static_cast<uint32_t>(requested_threads)
-    : std::thread::hardware_concurrency();
+    : std::max(1u, std::thread::hardware_concurrency());
 
+  this->max_spinning = std::thread::hardware_concurrency() / 2;
+  this->queues = std::make_unique<worker_queue[]>(num_threads);
   this->threads.resize(num_threads); // resize threads vector
 
   log_info("THREAD POOL: Creating thread pool of size: %u", num_threads);
-  for (auto &thread : this->threads) {
-    thread = std::thread(&thread_pool::thread_loop, this); // initialise every thread
+  for (size_t i = 0; i < num_threads; ++i) {
+    this->threads[i] = std::thread(&thread_pool::thread_loop, this, i); // initialise every thread
   }
 }
 
 // Close all open threads, letting them finish each job first
 thread_pool::~thread_pool() {
   { // after the mutex goes out of scope it is released
-    std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
+    std::unique_lock<std::mutex> lock(this->park_mutex); // no worker may be between its check and its wait
     this->should_terminate = true;
   }
 
-  mutex_condition.notify_all();
+  park_condition.notify_all();
   for (auto &thread : this->threads) {
     thread.join();
   }
-  
+
   log_info("THREAD POOL: Thread pool cleared.");
   threads.clear();
 }
 
-// Enqueue a job to the thread pool
-void thread_pool::queue_job(const job_t &job) {
+// Enqueue a job to the thread pool, refused when the queue is full
+bool thread_pool::queue_job(job_t &&job) {
+  if (this->max_depth > 0 && this->pending.load() >= this->max_depth)
+    return false; // a soft limit, concurrent producers may overshoot it by one each
+
+  // workers keep what they queue, everything else is dealt round-robin
+  size_t index = current_pool == this
+    ? current_index
+    : this->next_queue.fetch_add(1, std::memory_order_relaxed) % this->threads.size();
+
+  { // after the mutex goes out of scope it is released
+    std::lock_guard<std::mutex> lock(this->queues[index].lock);
+    this->queues[index].jobs.push_back(std::move(job));
+    this->pending++;
+  }
+
+  // a spinning worker will find the job by itself
+  if (this->spinning.load() == 0)
+    this->wake_one();
+
+  return true;
+}
+
+// Wake one parked worker as a searcher, unless someone is already searching or nobody sleeps
+void thread_pool::wake_one(void) {
+  if (this->sleepers.load() == 0)
+    return;
+
+  size_t searching = 0;
+  if (!this->spinning.compare_exchange_strong(searching, 1)) // the woken worker counts as spinning
+    return;
+
   { // after the mutex goes out of scope it is released
-    std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
-    this->jobs.push(job);
+    std::lock_guard<std::mutex> lock(this->park_mutex);
+    if (this->sleepers.load() == 0) {
+      this->spinning--;
+      return;
+    }
+    this->wake_tokens++;
   }
-  mutex_condition.notify_one();
+  park_condition.notify_one();
 }
 
 // Return if the pool is currently completing jobs
 bool thread_pool::is_busy(void) {
-  bool pool_busy;
+  return this->pending.load() > 0;
+}
+
+// Take the oldest job of our own deque, or steal the newest of another worker's
+bool thread_pool::try_pop(size_t index, job_t &job) {
+  if (this->pending.load(std::memory_order_relaxed) == 0)
+    return false;
+
   { // after the mutex goes out of scope it is released
-    std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
-    pool_busy = !jobs.empty();
+    worker_queue &own = this->queues[index];
+    std::lock_guard<std::mutex> lock(own.lock);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.front());
+      own.jobs.pop_front();
+      this->pending--;
+      return true;
+    }
   }
 
-  return pool_busy;
+  // steal the newer half of the first busy deque, so one steal feeds us for a while
+  size_t count = this->threads.size();
+  std::vector<job_t> stolen;
+  for (size_t i = 1; i < count && stolen.empty(); ++i) {
+    worker_queue &victim = this->queues[(index + i) % count];
+    std::unique_lock<std::mutex> lock(victim.lock, std::try_to_lock); // busy deque, try the next one
+    if (!lock.owns_lock() || victim.jobs.empty())
+      continue;
+
+    size_t take = (victim.jobs.size() + 1) / 2;
+    stolen.reserve(take);
+    for (size_t j = 0; j < take; ++j) {
+      stolen.push_back(std::move(victim.jobs.back()));
+      victim.jobs.pop_back();
+    }
+  }
+
+  if (stolen.empty())
+    return false;
+
+  // stolen runs newest to oldest, the oldest runs now and the rest keep their order on our deque
+  job = std::move(stolen.back());
+  this->pending--;
+
+  if (stolen.size() > 1) {
+    worker_queue &own = this->queues[index];
+    std::lock_guard<std::mutex> lock(own.lock);
+    for (size_t j = stolen.size() - 1; j-- > 0; ) {
+      own.jobs.push_back(std::move(stolen[j]));
+    }
+  }
+
+  return true;
 }
 
-// Main function for each thread. The thread waits for a job to become available then executes
-void thread_pool::thread_loop(void) {
+// Main function for each thread. The thread looks for a job, spinning briefly before it parks
+void thread_pool::thread_loop(size_t index) {
+  current_pool = this;
+  current_index = index;
+  bool searching = false; // counted in spinning, either spinning now or woken by wake_one
+
   for (;;) {
+    if (this->should_terminate)
+      return;
+
     job_t job;
+    bool found = this->try_pop(index, job);
 
-    { // look for next job
-      std::unique_lock<std::mutex> lock(this->queue_mutex); // prevent data races
-      mutex_condition.wait(lock, [this] {
-        return !this->jobs.empty() || this->should_terminate;
+    // spinning only pays off with spare cores, so only a few workers may do it at once
+    if (!found && !searching) {
+      searching = this->spinning.fetch_add(1) < this->max_spinning;
+      if (!searching)
+        this->spinning--;
+    }
+
+    if (!found && searching) {
+      for (int spins = 0; spins < SPIN_LIMIT && !found && !this->should_terminate; ++spins) {
+        cpu_relax();
+        found = this->try_pop(index, job);
+      }
+    }
+
+    if (searching) {
+      searching = false;
+      this->spinning--;
+
+      // hand the search on so the remaining jobs do not wait for a running one to finish
+      if (found && this->pending.load() > 0)
+        this->wake_one();
+    }
+
+    if (!found) { // nothing came along, sleep until a job is queued
+      std::unique_lock<std::mutex> lock(this->park_mutex);
+      this->sleepers++;
+      park_condition.wait(lock, [this] {
+        return this->wake_tokens > 0 || this->pending.load() > 0 || this->should_terminate;
       });
+      this->sleepers--;
 
-      if (should_terminate)
-        return;
-      
-      job = jobs.front(); // get the next job
-      jobs.pop(); // dequeue current job
+      if (this->wake_tokens > 0) { // woken by wake_one, we are the searcher now
+        this->wake_tokens--;
+        searching = true;
+      }
+      continue;
     }
 
     // run the job
     job.func(job.info);
   }
+}
+
+// Pin a thread to one CPU core, wrapping around when there are more threads than cores
+bool pin_thread(std::thread &thread, unsigned core) {
+  unsigned cores = std::thread::hardware_concurrency();
+  if (cores == 0)
+    return false;
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(core % cores, &cpu_set);
+
+  return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set) == 0;
 }
\ No newline at end of file
@@ -1,17 +1,21 @@
 #ifndef __POOL_HPP__
 #define __POOL_HPP__
 
-#include <functional>
 #include <thread>
+#include <chrono>
 #include <mutex>
 #include <vector>
-#include <queue>
+#include <deque>
+#include <memory>
+#include <atomic>
 #include <utility>
 #include <condition_variable>
 
 #include <openssl/ssl.h> // SSL structure
 #include <netinet/in.h> // struct sockaddr_in
 
+#include "task.hpp"
+
 // holds info for one job
 struct job_t {
   struct info_t {
@@ -20,29 +24,54 @@ struct job_t {
 
     SSL *ssl = nullptr;
     int client_fd = 0;
+    std::chrono::steady_clock::time_point queued_at{}; // when the connection was accepted
   };
 
   job_t::info_t info;
-  std::function<void(job_t::info_t)> func;
+  small_function<void(job_t::info_t)> func; // move-only, small callables stored inline
 };
 
 
+// Pin a thread to one CPU core, wrapping around when there are more threads than cores
+bool pin_thread(std::thread &thread, unsigned core);
+
+// Work-stealing pool. Every worker owns a deque: jobs queued from outside are dealt round-robin,
+// jobs queued by a worker go on its own deque. An idle worker takes from the front of its own
+// deque, then steals from the back of the others, spins for a short while and only then parks.
+// Only one wake-up is in flight at a time: a new job wakes a sleeper only when nobody is searching,
+// and a searcher that finds work wakes the next sleeper if more jobs are left.
 class thread_pool {
   public:
-    thread_pool(int num_threads = 0); // 0 = use hardware_concurrency
+    thread_pool(int num_threads = 0, size_t max_queue_depth = 0); // 0 = use hardware_concurrency / unbounded
     ~thread_pool();
 
-    void queue_job(const job_t &job);
+    bool queue_job(job_t &&job); // false (job left untouched) when max_queue_depth jobs are already waiting
     bool is_busy(void);
     size_t get_thread_count() const { return threads.size(); }
+    size_t get_queue_depth() const { return pending.load(); }
   private:
-    void thread_loop(void);
+    struct alignas(64) worker_queue {
+      std::mutex lock;
+      std::deque<job_t> jobs;
+    };
+
+    void thread_loop(size_t index);
+    bool try_pop(size_t index, job_t &job);
+    void wake_one(void);
+
+    std::atomic<bool> should_terminate{false};
+    std::atomic<size_t> pending{0}; // jobs sitting in any deque
+    std::atomic<size_t> sleepers{0}; // workers parked on park_condition
+    std::atomic<size_t> spinning{0}; // workers polling the deques, including woken ones not yet running
+    size_t wake_tokens = 0; // wake-ups handed out by wake_one, guarded by park_mutex
+    size_t max_spinning; // spinning only pays off with spare cores, at most half of them spin
+    std::atomic<size_t> next_queue{0};
+    size_t max_depth;
 
-    bool should_terminate = false;
-    std::mutex queue_mutex;
-    std::condition_variable mutex_condition;
+    std::unique_ptr<worker_queue[]> queues;
     std::vector<std::thread> threads;
-    std::queue<job_t> jobs;
+    std::mutex park_mutex;
+    std::condition_variable park_condition;
 };
 
 #endif
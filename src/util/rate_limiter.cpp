@@ -0,0 +1,166 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+
+
+// Mask away host bits past prefix_length (0-128) of a 128 bit address
+static void apply_prefix(ip_key &key, int prefix_length) {
+  prefix_length = std::clamp(prefix_length, 0, 128);
+  key.prefix = prefix_length;
+
+  if (prefix_length <= 64) {
+    key.high &= prefix_length == 0 ? 0 : ~0ULL << (64 - prefix_length);
+    key.low = 0;
+  } else if (prefix_length < 128) {
+    key.low &= ~0ULL << (128 - prefix_length);
+  }
+}
+
+// Key an IPv4 client, aggregated to a /prefix_length subnet
+ip_key ip_key::from_ipv4(const struct in_addr &address, int prefix_length) {
+  ip_key key;
+  key.low = 0x0000ffff00000000ULL | ntohl(address.s_addr);
+  apply_prefix(key, 96 + std::clamp(prefix_length, 0, 32));
+  return key;
+}
+
+// Key an IPv6 client, aggregated to a /prefix_length subnet
+ip_key ip_key::from_ipv6(const struct in6_addr &address, int prefix_length) {
+  ip_key key;
+  for (int i = 0; i < 8; ++i) {
+    key.high = (key.high << 8) | address.s6_addr[i];
+    key.low = (key.low << 8) | address.s6_addr[i + 8];
+  }
+  apply_prefix(key, prefix_length);
+  return key;
+}
+
+// Printable form of the key, e.g. 192.0.2.50 or 2001:db8::/64
+std::string ip_key::to_string() const {
+  char buffer[INET6_ADDRSTRLEN];
+
+  if (this->high == 0 && (this->low >> 32) == 0xffff) {
+    struct in_addr address;
+    address.s_addr = htonl(static_cast<uint32_t>(this->low));
+    inet_ntop(AF_INET, &address, buffer, sizeof(buffer));
+
+    std::string result(buffer);
+    if (this->prefix < 128)
+      result += "/" + std::to_string(this->prefix - 96);
+    return result;
+  }
+
+  struct in6_addr address;
+  for (int i = 0; i < 8; ++i) {
+    address.s6_addr[i] = this->high >> (56 - 8 * i);
+    address.s6_addr[i + 8] = this->low >> (56 - 8 * i);
+  }
+  inet_ntop(AF_INET6, &address, buffer, sizeof(buffer));
+
+  std::string result(buffer);
+  if (this->prefix < 128)
+    result += "/" + std::to_string(this->prefix);
+  return result;
+}
+
+// splitmix64 finaliser over both halves, spreads neighbouring addresses across shards
+size_t ip_key_hash::operator()(const ip_key &key) const {
+  uint64_t x = key.high ^ (key.low * 0x9e3779b97f4a7c15ULL) ^ key.prefix;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+
+rate_limiter::rate_limiter(unsigned long max_requests, time_t time_window, int ipv4_prefix, int ipv6_prefix) {
+  this->capacity = std::max(1UL, max_requests);
+  this->refill_per_second = this->capacity / std::max<time_t>(1, time_window);
+  this->ipv4_prefix = ipv4_prefix;
+  this->ipv6_prefix = ipv6_prefix;
+}
+
+bool rate_limiter::allow(const struct in_addr &address) {
+  return this->take_token(ip_key::from_ipv4(address, this->ipv4_prefix));
+}
+
+bool rate_limiter::allow(const struct in6_addr &address) {
+  return this->take_token(ip_key::from_ipv6(address, this->ipv6_prefix));
+}
+
+// Refill the client's bucket for the time passed and take one token, new clients start full
+bool rate_limiter::take_token(const ip_key &key) {
+  size_t hash = ip_key_hash()(key);
+  shard &owner = this->shards[hash >> 58]; // top bits pick the shard, the map uses the low ones
+  auto now = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(owner.lock);
+  auto [it, inserted] = owner.buckets.try_emplace(key);
+  bucket &entry = it->second;
+
+  if (inserted) {
+    entry.tokens = this->capacity;
+  } else {
+    double elapsed = std::chrono::duration<double>(now - entry.last_refill).count();
+    entry.tokens = std::min(this->capacity, entry.tokens + elapsed * this->refill_per_second);
+  }
+
+  entry.last_refill = now;
+  entry.last_seen = time(nullptr);
+  entry.requests++;
+
+  if (entry.tokens < 1.0) {
+    entry.rejected++;
+    this->rejected_total.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  entry.tokens -= 1.0;
+  return true;
+}
+
+// Forget clients not seen for idle_seconds, one shard locked at a time
+size_t rate_limiter::cull(time_t now, time_t idle_seconds) {
+  size_t removed = 0;
+
+  for (shard &current : this->shards) {
+    std::lock_guard<std::mutex> lock(current.lock);
+    for (auto it = current.buckets.begin(); it != current.buckets.end(); ) {
+      if (now - it->second.last_seen > idle_seconds) {
+        it = current.buckets.erase(it);
+        removed++;
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  return removed;
+}
+
+// Copy out every tracked client, each shard is read under its lock
+std::vector<rate_limit_record> rate_limiter::snapshot() const {
+  std::vector<rate_limit_record> records;
+  records.reserve(this->size());
+
+  for (const shard &current : this->shards) {
+    std::lock_guard<std::mutex> lock(current.lock);
+    for (const auto &[key, entry] : current.buckets) {
+      records.push_back({key, entry.requests, entry.rejected, entry.last_seen});
+    }
+  }
+
+  return records;
+}
+
+// Number of tracked clients
+size_t rate_limiter::size() const {
+  size_t total = 0;
+
+  for (const shard &current : this->shards) {
+    std::lock_guard<std::mutex> lock(current.lock);
+    total += current.buckets.size();
+  }
+
+  return total;
+}
@@ -0,0 +1,84 @@
+#ifndef __RATE_LIMITER_HPP__
+#define __RATE_LIMITER_HPP__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+#include <netinet/in.h>
+
+// Client address as 128 bits, IPv4 is stored IPv4-mapped (::ffff:a.b.c.d) so both families share
+// one table. Host bits past the aggregation prefix are zeroed, so a whole subnet shares a key.
+struct ip_key {
+  uint64_t high = 0;
+  uint64_t low = 0;
+  uint8_t prefix = 128; // prefix length in IPv6 terms, 96 + n for an IPv4 /n
+
+  static ip_key from_ipv4(const struct in_addr &address, int prefix_length = 32);
+  static ip_key from_ipv6(const struct in6_addr &address, int prefix_length = 128);
+
+  bool operator==(const ip_key &other) const { return high == other.high && low == other.low && prefix == other.prefix; }
+  std::string to_string() const; // dotted or colon notation, with /prefix when aggregated
+};
+
+struct ip_key_hash {
+  size_t operator()(const ip_key &key) const;
+};
+
+// One tracked client, as returned by snapshot()
+struct rate_limit_record {
+  ip_key key;
+  unsigned long requests; // connections seen since the entry was created
+  unsigned long rejected; // of those, how many were refused
+  time_t last_seen;
+};
+
+// Per-client token buckets. Each client may burst up to max_requests connections and regains
+// max_requests tokens per time_window seconds. The table is split into shards with their own
+// lock, so concurrent listeners rarely contend and stats never race with inserts.
+class rate_limiter {
+  public:
+    rate_limiter(unsigned long max_requests, time_t time_window, int ipv4_prefix = 32, int ipv6_prefix = 128);
+
+    // Take a token for this client, false if it has none left
+    bool allow(const struct in_addr &address);
+    bool allow(const struct in6_addr &address);
+
+    // Forget clients not seen for idle_seconds, returns how many were removed
+    size_t cull(time_t now, time_t idle_seconds);
+
+    std::vector<rate_limit_record> snapshot() const; // consistent per shard
+    size_t size() const;
+    unsigned long get_rejected_count() const { return rejected_total.load(std::memory_order_relaxed); }
+  private:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    struct bucket {
+      double tokens;
+      std::chrono::steady_clock::time_point last_refill;
+      unsigned long requests = 0;
+      unsigned long rejected = 0;
+      time_t last_seen;
+    };
+
+    struct alignas(64) shard {
+      mutable std::mutex lock;
+      std::unordered_map<ip_key, bucket, ip_key_hash> buckets;
+    };
+
+    bool take_token(const ip_key &key);
+
+    double capacity;
+    double refill_per_second;
+    int ipv4_prefix;
+    int ipv6_prefix;
+    shard shards[SHARD_COUNT];
+    std::atomic<unsigned long> rejected_total{0};
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __TASK_HPP__
+#define __TASK_HPP__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+template <typename Signature, size_t Capacity = 48>
+class small_function;
+
+// Move-only replacement for std::function. Callables up to Capacity bytes (function pointers, lambdas
+// capturing a few pointers) live inside the object, so queueing one never touches the heap; larger
+// ones fall back to a single allocation.
+template <typename R, typename... Args, size_t Capacity>
+class small_function<R(Args...), Capacity> {
+  public:
+    small_function() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, small_function>>>
+    small_function(F &&callable) {
+      using T = std::decay_t<F>;
+
+      if constexpr (fits_inline<T>()) {
+        new (&storage) T(std::forward<F>(callable));
+        ops = &inline_operations<T>::table;
+      } else {
+        *reinterpret_cast<T **>(&storage) = new T(std::forward<F>(callable));
+        ops = &heap_operations<T>::table;
+      }
+    }
+
+    small_function(small_function &&other) noexcept { take(other); }
+
+    small_function &operator=(small_function &&other) noexcept {
+      if (this != &other) {
+        reset();
+        take(other);
+      }
+      return *this;
+    }
+
+    small_function(const small_function &) = delete;
+    small_function &operator=(const small_function &) = delete;
+
+    ~small_function() { reset(); }
+
+    R operator()(Args... args) { return ops->invoke(&storage, std::forward<Args>(args)...); }
+    explicit operator bool() const { return ops != nullptr; }
+  private:
+    struct operations {
+      R (*invoke)(void *callable, Args &&...args);
+      void (*move)(void *destination, void *source); // move-construct into destination, destroy source
+      void (*destroy)(void *callable);
+    };
+
+    template <typename T>
+    static constexpr bool fits_inline() {
+      return sizeof(T) <= Capacity && alignof(T) <= alignof(std::max_align_t) &&
+             std::is_nothrow_move_constructible_v<T>;
+    }
+
+    template <typename T>
+    struct inline_operations {
+      static R invoke(void *callable, Args &&...args) { return (*static_cast<T *>(callable))(std::forward<Args>(args)...); }
+      static void move(void *destination, void *source) {
+        new (destination) T(std::move(*static_cast<T *>(source)));
+        static_cast<T *>(source)->~T();
+      }
+      static void destroy(void *callable) { static_cast<T *>(callable)->~T(); }
+      static constexpr operations table = { invoke, move, destroy };
+    };
+
+    template <typename T>
+    struct heap_operations {
+      static R invoke(void *callable, Args &&...args) { return (**static_cast<T **>(callable))(std::forward<Args>(args)...); }
+      static void move(void *destination, void *source) { *static_cast<T **>(destination) = *static_cast<T **>(source); }
+      static void destroy(void *callable) { delete *static_cast<T **>(callable); }
+      static constexpr operations table = { invoke, move, destroy };
+    };
+
+    void take(small_function &other) {
+      if (other.ops) {
+        other.ops->move(&storage, &other.storage);
+        ops = other.ops;
+        other.ops = nullptr;
+      }
+    }
+
+    void reset() {
+      if (ops) {
+        ops->destroy(&storage);
+        ops = nullptr;
+      }
+    }
+
+    alignas(std::max_align_t) unsigned char storage[Capacity];
+    const operations *ops = nullptr;
+};
+
+#endif
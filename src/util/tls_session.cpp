@@ -0,0 +1,145 @@
+#include "tls_session.hpp"
+
+#include <stdexcept>
+#include <cstring>
+
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+
+#define SESSION_ID_CONTEXT "secure-serve"
+
+
+// ex_data slot of an SSL_CTX holding its ticket_keys
+static int ticket_keys_index() {
+  static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+ticket_keys::ticket_keys(std::chrono::seconds rotation, std::chrono::seconds lifetime) : rotation(rotation), lifetime(lifetime) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->rotate(clock::now());
+}
+
+// Wipe every key before the memory is freed
+ticket_keys::~ticket_keys() {
+  for (key &each : this->keys) {
+    OPENSSL_cleanse(&each, sizeof(each));
+  }
+}
+
+void ticket_keys::attach(SSL_CTX *ctx) {
+  SSL_CTX_set_ex_data(ctx, ticket_keys_index(), this);
+  SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, callback);
+}
+
+// Make a fresh newest key and drop those whose tickets can no longer be valid: a key stops sealing
+// once replaced, and what it sealed last expires lifetime after that
+void ticket_keys::rotate(clock::time_point now) {
+  key fresh;
+  if (RAND_bytes(fresh.name, sizeof(fresh.name)) != 1 || RAND_bytes(fresh.aes, sizeof(fresh.aes)) != 1 ||
+      RAND_bytes(fresh.hmac, sizeof(fresh.hmac)) != 1) {
+    throw std::runtime_error("Unable to generate session ticket keys.");
+  }
+  fresh.created = now;
+
+  clock::time_point replaced = now;
+  for (auto it = this->keys.begin(); it != this->keys.end(); ++it) {
+    if (now - replaced >= this->lifetime) {
+      for (auto old = it; old != this->keys.end(); ++old) {
+        OPENSSL_cleanse(&*old, sizeof(*old));
+      }
+      this->keys.erase(it, this->keys.end());
+      break;
+    }
+    replaced = it->created; // the next older key stopped sealing when this one was made
+  }
+
+  this->keys.push_front(fresh);
+  OPENSSL_cleanse(&fresh, sizeof(fresh));
+  this->rotations++;
+}
+
+void ticket_keys::rotate_if_due() {
+  clock::time_point now = clock::now();
+  if (now - this->keys.front().created >= this->rotation)
+    this->rotate(now);
+}
+
+void ticket_keys::newest(key &out) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->rotate_if_due();
+  out = this->keys.front();
+}
+
+// Rotating here as well means a ticket under a key past its interval is renewed, a resumed TLS 1.3
+// connection is otherwise never sent a new ticket
+int ticket_keys::find(const unsigned char *name, key &out) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->rotate_if_due();
+  for (size_t i = 0; i < this->keys.size(); ++i) {
+    if (CRYPTO_memcmp(this->keys[i].name, name, sizeof(out.name)) == 0) {
+      out = this->keys[i];
+      return i == 0 ? 1 : 2;
+    }
+  }
+  return 0;
+}
+
+// OpenSSL's ticket key callback. Sealing returns 1 with the cipher and MAC keyed, opening returns
+// 1, 2 to also issue a ticket under the newest key, 0 to fall back to a full handshake, -1 on error.
+// TLS 1.3 clients use a ticket only once, so a resumed TLS 1.3 connection always gets a new one.
+int ticket_keys::callback(SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int seal) {
+  auto *self = static_cast<ticket_keys *>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ticket_keys_index()));
+  if (!self)
+    return -1;
+
+  key chosen;
+  int result;
+  if (seal) {
+    self->newest(chosen);
+    memcpy(name, chosen.name, sizeof(chosen.name));
+    result = RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) == 1 &&
+             EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, chosen.aes, iv) == 1 ? 1 : -1;
+  } else {
+    result = self->find(name, chosen);
+    if (result == 1 && SSL_version(ssl) >= TLS1_3_VERSION)
+      result = 2;
+    if (result > 0 && EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, chosen.aes, iv) != 1)
+      result = -1;
+  }
+
+  if (result > 0) {
+    OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, chosen.hmac, sizeof(chosen.hmac)),
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0),
+      OSSL_PARAM_construct_end()
+    };
+    if (EVP_MAC_CTX_set_params(mac, params) != 1)
+      result = -1;
+  }
+
+  OPENSSL_cleanse(&chosen, sizeof(chosen));
+  return result;
+}
+
+void configure_session_resumption(SSL_CTX *ctx, size_t cache_size, std::chrono::seconds lifetime, ticket_keys *keys) {
+  // sessions are only resumed by the server that issued them
+  SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char *>(SESSION_ID_CONTEXT), strlen(SESSION_ID_CONTEXT));
+  SSL_CTX_set_timeout(ctx, lifetime.count());
+
+  if (cache_size > 0) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, cache_size);
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+  }
+
+  if (keys) {
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+    keys->attach(ctx);
+  } else {
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+}
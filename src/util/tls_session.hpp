@@ -0,0 +1,52 @@
+#ifndef __TLS_SESSION_HPP__
+#define __TLS_SESSION_HPP__
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#include <openssl/ssl.h>
+
+// Keys sealing stateless session tickets, generated and rotated in process. New tickets are sealed
+// with the newest key every rotation interval; older keys stay usable for opening tickets for as long
+// as a ticket they sealed may live. A ticket opened with an old key is replaced by a fresh one, as is
+// every TLS 1.3 ticket, since clients use those only once.
+// Keys never leave memory, so a restart invalidates every outstanding ticket.
+class ticket_keys {
+  public:
+    ticket_keys(std::chrono::seconds rotation, std::chrono::seconds lifetime);
+    ~ticket_keys();
+
+    // Seal and open the tickets of every connection made from ctx with these keys
+    void attach(SSL_CTX *ctx);
+    unsigned long get_rotation_count() const { return rotations.load(std::memory_order_relaxed); }
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct key {
+      unsigned char name[16]; // sent in the clear with the ticket, picks the key to open it with
+      unsigned char aes[32];
+      unsigned char hmac[32];
+      clock::time_point created;
+    };
+
+    static int callback(SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int seal);
+    void newest(key &out);
+    int find(const unsigned char *name, key &out); // 1 for the newest key, 2 for an older one, 0 if expired or unknown
+    void rotate_if_due(); // with lock held
+    void rotate(clock::time_point now); // with lock held
+
+    std::chrono::seconds rotation, lifetime;
+    mutable std::mutex lock; // guards keys, taken for a moment once per handshake
+    std::deque<key> keys; // newest first
+    std::atomic<unsigned long> rotations{0};
+};
+
+// Turn on session resumption for ctx. Sessions are remembered in OpenSSL's thread-safe server cache
+// (at most cache_size, 0 disables it) and expire after lifetime. With keys, TLS 1.3 clients get
+// stateless tickets sealed by them, without they get tickets that refer to the cache.
+void configure_session_resumption(SSL_CTX *ctx, size_t cache_size, std::chrono::seconds lifetime, ticket_keys *keys);
+
+#endif
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <fstream>
+
+#include "util/ip_snapshot.hpp"
+
+// Convert a binary IP table snapshot (logs/ip_log.bin) to CSV
+// usage: ip_log_csv <snapshot> [output.csv], writes to stdout without an output path
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "usage: " << argv[0] << " <snapshot> [output.csv]" << std::endl;
+    return 1;
+  }
+
+  auto records = read_ip_snapshot(argv[1]);
+  if (!records) {
+    std::cerr << "ERROR: " << argv[1] << " is not a readable IP snapshot" << std::endl;
+    return 1;
+  }
+
+  if (argc == 2) {
+    write_ip_csv(*records, std::cout);
+    return 0;
+  }
+
+  std::ofstream out(argv[2], std::ios::out | std::ios::trunc);
+  if (!out.is_open()) {
+    std::cerr << "ERROR: unable to open " << argv[2] << std::endl;
+    return 1;
+  }
+
+  write_ip_csv(*records, out);
+  return 0;
+}